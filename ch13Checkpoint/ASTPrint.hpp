@@ -9,6 +9,7 @@
 #include <typeinfo>
 
 #include "Expr.hpp"
+#include "LoxString.hpp"
 
 // note: In ch08, I realized that I had some boo boos. Instead of completely restarting, I am going to make the edits within this chapter
 // the main issues were in my GenerateAST.cpp and Parser.cpp as I am really good at skipping code and not reading directions fully :)
@@ -37,6 +38,7 @@ class ASTPrinter : public ExprVisitor {
             auto& valType = expr->value.type();
             if (valType == typeid(nullptr)) return "nil";
             else if (valType == typeid(std::string))  return std::any_cast<std::string>(expr->value);
+            else if (valType == typeid(std::shared_ptr<LoxString>)) return std::any_cast<std::shared_ptr<LoxString>>(expr->value)->str();
             else if (valType == typeid(double)) return std::to_string(std::any_cast<double>(expr->value));
             else if (valType == typeid(bool)) return std::any_cast<bool>(expr->value) ? "true" : "false";
 
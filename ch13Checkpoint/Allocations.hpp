@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+
+// added for allocation accounting... counts every runtime object and AST node as it's made and destroyed. Bytes are
+// the objects' own sizes (plus string characters), not the shared_ptr control blocks or what containers inside them
+// point to, so they're a floor on real usage but track it well enough to compare scripts and spot leaks.
+// Shown by --stats at exit, and to scripts through the heapStats() and liveBytes() natives.
+enum class AllocationKind { ENVIRONMENT, FUNCTION, CLASS, INSTANCE, STRING, AST_NODE, COUNT };
+
+class Allocations {
+    struct Counter {
+        long long allocated = 0;
+        long long live = 0;
+        long long liveBytes = 0;
+        long long peakBytes = 0;
+    };
+
+    // plain counters with no destructor, so objects that die during static destruction can still count themselves
+    std::array<Counter, static_cast<size_t>(AllocationKind::COUNT)> counters{};
+
+    Counter& counter (AllocationKind kind) { return counters[static_cast<size_t>(kind)]; }
+
+    public:
+        void allocate (AllocationKind kind, size_t bytes) {
+            Counter& c = counter(kind);
+            c.allocated++;
+            c.live++;
+            addBytes(kind, static_cast<long long>(bytes));
+        }
+
+        void release (AllocationKind kind, size_t bytes) {
+            counter(kind).live--;
+            addBytes(kind, -static_cast<long long>(bytes));
+        }
+
+        // for memory an object picks up or lets go of after it's made, like a rope string flattening
+        void addBytes (AllocationKind kind, long long bytes) {
+            Counter& c = counter(kind);
+            c.liveBytes += bytes;
+            if (c.liveBytes > c.peakBytes) c.peakBytes = c.liveBytes;
+        }
+
+        long long liveBytes () const {
+            long long total = 0;
+            for (const Counter& c : counters) total += c.liveBytes;
+            return total;
+        }
+
+        void report (std::ostream& out) const {
+            static constexpr const char* NAMES[] = {"Environment", "LoxFunction", "LoxClass", "LoxInstance", "string", "AST node"};
+
+            out << "== heap stats ==\n";
+            out << std::left << std::setw(14) << "kind" << std::right << std::setw(14) << "allocated"
+                << std::setw(12) << "live" << std::setw(14) << "live bytes" << std::setw(14) << "peak bytes" << "\n";
+            for (size_t i = 0; i < counters.size(); i++) {
+                const Counter& c = counters[i];
+                out << std::left << std::setw(14) << NAMES[i] << std::right << std::setw(14) << c.allocated
+                    << std::setw(12) << c.live << std::setw(14) << c.liveBytes << std::setw(14) << c.peakBytes << "\n";
+            }
+            out << "total live bytes: " << liveBytes() << "\n";
+        }
+};
+
+inline Allocations allocations;
+
+// a base that counts T under kind for as long as it lives... derive from Counted<T, kind> and that's all it takes
+template <typename T, AllocationKind kind>
+struct Counted {
+    Counted () { allocations.allocate(kind, sizeof(T)); }
+    Counted (const Counted&) { allocations.allocate(kind, sizeof(T)); }
+    Counted& operator= (const Counted&) = default;
+    ~Counted () { allocations.release(kind, sizeof(T)); }
+};
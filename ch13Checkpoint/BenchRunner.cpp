@@ -0,0 +1,95 @@
+// added for the benchmark suite... runs each bench/*.lox script several times under the interpreter and writes one
+// tab-separated line per script: name, runs, median and min wall seconds, peak resident set size in KiB
+//
+// usage: bench_runner <interpreter> <runs> <script>...
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Run {
+    double seconds;
+    long maxRSS; // KiB on Linux
+    bool ok;
+};
+
+// the script's own output goes to /dev/null so printing doesn't count against it
+Run runOnce (const std::string& interpreter, const std::string& script) {
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+    if (pid < 0) return {0, 0, false};
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) { dup2(null, STDOUT_FILENO); dup2(null, STDERR_FILENO); }
+        execl(interpreter.c_str(), interpreter.c_str(), script.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage{};
+    if (wait4(pid, &status, 0, &usage) < 0) return {0, 0, false};
+
+    double seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+    return {seconds, usage.ru_maxrss, WIFEXITED(status) && WEXITSTATUS(status) == 0};
+}
+
+std::string benchName (const std::string& script) {
+    std::string name = script.substr(script.find_last_of('/') + 1);
+    size_t dot = name.rfind(".lox");
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+int main (int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: bench_runner <interpreter> <runs> <script>..." << std::endl;
+        return 64;
+    }
+
+    std::string interpreter = argv[1];
+    int runs = std::atoi(argv[2]);
+    if (runs < 1) {
+        std::cerr << "Runs must be at least 1." << std::endl;
+        return 64;
+    }
+
+    int failures = 0;
+    std::cout << "benchmark\truns\tmedian_s\tmin_s\tpeak_rss_kb" << std::endl;
+
+    for (int i = 3; i < argc; i++) {
+        std::string script = argv[i];
+        std::vector<double> times;
+        long peak = 0;
+        bool ok = true;
+
+        for (int run = 0; run < runs && ok; run++) {
+            Run result = runOnce(interpreter, script);
+            ok = result.ok;
+            times.push_back(result.seconds);
+            peak = std::max(peak, result.maxRSS);
+        }
+
+        if (!ok) {
+            // a failing benchmark still gets a line so the columns stay aligned with the script list
+            std::cout << benchName(script) << "\t" << times.size() << "\tfailed\tfailed\t" << peak << std::endl;
+            failures++;
+            continue;
+        }
+
+        std::sort(times.begin(), times.end());
+        size_t middle = times.size() / 2;
+        double median = times.size() % 2 ? times[middle] : (times[middle - 1] + times[middle]) / 2;
+
+        std::cout << benchName(script) << "\t" << runs << "\t" << median << "\t" << times.front() << "\t" << peak << std::endl;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
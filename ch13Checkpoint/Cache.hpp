@@ -0,0 +1,723 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+// getpid is POSIX. Anywhere else the temporary file is told apart by a random number instead
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#else
+#include <atomic>
+#include <random>
+#endif
+
+#include "Interpreter.hpp"
+#include "Optimizer.hpp"
+
+// added for --cache... keeps the program run() hands to the Interpreter (the tree after the Resolver and Optimizer,
+// plus everything the Resolver told the Interpreter about it) in a file named after a hash of the source, so running
+// the same script again skips scanning, parsing, resolving and optimizing. The hash covers the source, the format
+// version and when this interpreter was built, so editing the script or rebuilding cll just misses the cache.
+//
+// The file is the statements in preorder. Each node is its kind (the same tag the Interpreter dispatches on) followed
+// by its fields; a missing child is NONE and a node already written is REF and its number. After the tree come the
+// Interpreter's side tables, keyed by node number. The state the Interpreter fills in as it runs (VariableCache,
+// BinaryState, CountedLoop...) isn't written, a loaded program starts out unspecialized like a parsed one. Anything
+// that doesn't read back cleanly (truncated, another build, a hash collision) is just a miss.
+
+// the parts of the file ProgramWriter and ProgramReader agree on
+struct ProgramFile {
+    // child tags, past the last kind
+    static constexpr std::uint8_t NONE = 0xFE;
+    static constexpr std::uint8_t REF = 0xFF;
+
+    // literal tags
+    enum class ValueTag : std::uint8_t { EMPTY, NIL, BOOL, NUMBER, STRING };
+
+    struct Corrupt {}; // thrown while reading
+    struct Unsupported {}; // a value the file can't hold, thrown while writing
+
+    // FNV-1a
+    static std::uint64_t hash (std::string_view text, std::uint64_t hash = 14695981039346656037ull) {
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static bool read (const std::filesystem::path& path, std::string& in) {
+        std::ifstream file{path, std::ios::binary};
+        if (!file) return false;
+        in.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // written to a temporary file and renamed into place, so another cll reading it never sees half a file
+    static bool write (const std::filesystem::path& path, const std::string& out) {
+        std::error_code error;
+        if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), error);
+        std::filesystem::path temporary = path;
+        temporary += "." + uniqueSuffix();
+        {
+            std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+            if (!file.write(out.data(), out.size())) {
+                file.close();
+                std::filesystem::remove(temporary, error);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error) std::filesystem::remove(temporary, error);
+        return !error;
+    }
+
+    // different for every cll writing at the same time, a process only writes one file at a time
+    static std::string uniqueSuffix () {
+#if defined(__unix__) || defined(__APPLE__)
+        return std::to_string(getpid());
+#else
+        static std::atomic<unsigned> writes{0};
+        return std::to_string(std::random_device{}()) + "-" + std::to_string(writes++);
+#endif
+    }
+};
+
+// writes trees in preorder, numbering every node it writes, then the side tables for those nodes
+class ProgramWriter: public ProgramFile {
+    public:
+        std::string out;
+        std::unordered_map<const Expr*, std::uint32_t> exprs;
+        std::unordered_map<const Stmt*, std::uint32_t> stmts;
+
+        template <typename T>
+        void raw (T value) { out.append(reinterpret_cast<const char*>(&value), sizeof value); }
+
+        void text (std::string_view s) {
+            raw(static_cast<std::uint32_t>(s.size()));
+            out.append(s);
+        }
+
+        void value (const std::any& value) {
+            if (!value.has_value()) raw(ValueTag::EMPTY);
+            else if (value.type() == typeid(std::nullptr_t)) raw(ValueTag::NIL);
+            else if (value.type() == typeid(bool)) {
+                raw(ValueTag::BOOL);
+                raw<std::uint8_t>(std::any_cast<bool>(value));
+            }
+            else if (value.type() == typeid(double)) {
+                raw(ValueTag::NUMBER);
+                raw(std::any_cast<double>(value));
+            }
+            else if (value.type() == typeid(std::shared_ptr<LoxString>)) {
+                raw(ValueTag::STRING);
+                text(std::any_cast<const std::shared_ptr<LoxString>&>(value)->str());
+            }
+            else throw Unsupported{};
+        }
+
+        void token (const Token& token) {
+            raw(static_cast<std::uint8_t>(token.type));
+            text(token.lexeme);
+            value(token.literal);
+            raw(static_cast<std::int32_t>(token.line));
+        }
+
+        void tokens (const std::vector<Token>& tokens) {
+            raw(static_cast<std::uint32_t>(tokens.size()));
+            for (const Token& t : tokens) token(t);
+        }
+
+        // a node that's already been written is only referred to, so nothing the Optimizer shares gets copied
+        template <typename Node>
+        bool seen (std::unordered_map<const Node*, std::uint32_t>& ids, const Node* node) {
+            if (node == nullptr) {
+                raw(NONE);
+                return true;
+            }
+            auto id = ids.find(node);
+            if (id != ids.end()) {
+                raw(REF);
+                raw(id->second);
+                return true;
+            }
+            std::uint32_t next = ids.size();
+            ids.emplace(node, next);
+            raw(static_cast<std::uint8_t>(node->kind));
+            return false;
+        }
+
+        template <typename Node>
+        void list (const std::vector<std::shared_ptr<Node>>& nodes) {
+            raw(static_cast<std::uint32_t>(nodes.size()));
+            for (const auto& node : nodes) write(node.get());
+        }
+
+        void write (const Expr* expr) {
+            if (seen(exprs, expr)) return;
+
+            switch (expr->kind) {
+                case ExprKind::Assign: {
+                    auto node = static_cast<const Assign*>(expr);
+                    token(node->name);
+                    write(node->value.get());
+                    break;
+                }
+                case ExprKind::Binary: {
+                    auto node = static_cast<const Binary*>(expr);
+                    write(node->left.get());
+                    token(node->op);
+                    write(node->right.get());
+                    break;
+                }
+                case ExprKind::Call: {
+                    auto node = static_cast<const Call*>(expr);
+                    write(node->callee.get());
+                    token(node->paren);
+                    list(node->arguments);
+                    break;
+                }
+                case ExprKind::Invoke: {
+                    auto node = static_cast<const Invoke*>(expr);
+                    write(node->object.get());
+                    token(node->name);
+                    token(node->paren);
+                    list(node->arguments);
+                    break;
+                }
+                case ExprKind::GET: {
+                    auto node = static_cast<const GET*>(expr);
+                    write(node->object.get());
+                    token(node->name);
+                    break;
+                }
+                case ExprKind::Grouping: write(static_cast<const Grouping*>(expr)->expression.get()); break;
+                case ExprKind::Literal: value(static_cast<const Literal*>(expr)->value); break;
+                case ExprKind::SET: {
+                    auto node = static_cast<const SET*>(expr);
+                    write(node->object.get());
+                    token(node->name);
+                    write(node->value.get());
+                    break;
+                }
+                case ExprKind::SUPER: {
+                    auto node = static_cast<const SUPER*>(expr);
+                    token(node->keyword);
+                    token(node->method);
+                    break;
+                }
+                case ExprKind::THIS: token(static_cast<const THIS*>(expr)->keyword); break;
+                case ExprKind::Logical: {
+                    auto node = static_cast<const Logical*>(expr);
+                    write(node->left.get());
+                    token(node->op);
+                    write(node->right.get());
+                    break;
+                }
+                case ExprKind::Unary: {
+                    auto node = static_cast<const Unary*>(expr);
+                    token(node->op);
+                    write(node->right.get());
+                    break;
+                }
+                case ExprKind::Variable: token(static_cast<const Variable*>(expr)->name); break;
+            }
+        }
+
+        void write (const Stmt* stmt) {
+            if (seen(stmts, stmt)) return;
+
+            switch (stmt->kind) {
+                case StmtKind::Block: list(static_cast<const Block*>(stmt)->statements); break;
+                case StmtKind::CLASS: {
+                    auto node = static_cast<const CLASS*>(stmt);
+                    token(node->name);
+                    write(node->superclass.get());
+                    list(node->methods);
+                    break;
+                }
+                case StmtKind::Expression: write(static_cast<const Expression*>(stmt)->expression.get()); break;
+                case StmtKind::FOR: {
+                    auto node = static_cast<const FOR*>(stmt);
+                    write(node->initializer.get());
+                    write(node->condition.get());
+                    write(node->increment.get());
+                    write(node->body.get());
+                    break;
+                }
+                case StmtKind::Function: {
+                    auto node = static_cast<const Function*>(stmt);
+                    token(node->name);
+                    tokens(node->params);
+                    list(node->body);
+                    break;
+                }
+                case StmtKind::IF: {
+                    auto node = static_cast<const IF*>(stmt);
+                    write(node->condition.get());
+                    write(node->thenBranch.get());
+                    write(node->elseBranch.get());
+                    raw<std::uint8_t>(node->test != nullptr); // the Optimizer only ever sets it to the condition
+                    break;
+                }
+                case StmtKind::PRINT: write(static_cast<const PRINT*>(stmt)->expression.get()); break;
+                case StmtKind::RETURN: {
+                    auto node = static_cast<const RETURN*>(stmt);
+                    token(node->keyword);
+                    write(node->value.get());
+                    break;
+                }
+                case StmtKind::VAR: {
+                    auto node = static_cast<const VAR*>(stmt);
+                    token(node->name);
+                    write(node->initializer.get());
+                    break;
+                }
+                case StmtKind::WHILE: {
+                    auto node = static_cast<const WHILE*>(stmt);
+                    write(node->condition.get());
+                    write(node->body.get());
+                    raw<std::uint8_t>(node->test != nullptr);
+                    break;
+                }
+            }
+        }
+
+        // only the entries for nodes in the tree, the rest belong to nodes the Optimizer dropped
+        template <typename Node, typename Value, typename WriteValue>
+        void table (const std::unordered_map<std::shared_ptr<Node>, Value>& map,
+                    const std::unordered_map<const Node*, std::uint32_t>& ids, WriteValue writeValue) {
+            std::vector<std::pair<std::uint32_t, const Value*>> entries;
+            for (const auto& [node, value] : map) {
+                auto id = ids.find(node.get());
+                if (id != ids.end()) entries.emplace_back(id->second, &value);
+            }
+            raw(static_cast<std::uint32_t>(entries.size()));
+            for (const auto& [id, value] : entries) {
+                raw(id);
+                writeValue(*value);
+            }
+        }
+
+        void tables (const Interpreter& interpreter) {
+            auto writeLocal = [&] (const Interpreter::Local& local) {
+                raw(static_cast<std::int32_t>(local.slot));
+                raw(static_cast<std::int32_t>(local.upvalue));
+            };
+            table(interpreter.locals, exprs, writeLocal);
+            table(interpreter.receivers, exprs, writeLocal);
+            table(interpreter.slots, stmts, [&] (int slot) { raw(static_cast<std::int32_t>(slot)); });
+            table(interpreter.layouts, stmts, [&] (const Interpreter::ScopeLayout& layout) {
+                raw<std::uint8_t>(layout.captured);
+                raw(static_cast<std::int32_t>(layout.slotStart));
+                raw(static_cast<std::int32_t>(layout.slotEnd));
+            });
+            table(interpreter.captures, stmts, [&] (const std::vector<Interpreter::Capture>& upvalues) {
+                raw(static_cast<std::uint32_t>(upvalues.size()));
+                for (const Interpreter::Capture& capture : upvalues) {
+                    raw<std::uint8_t>(capture.isLocal);
+                    raw(static_cast<std::int32_t>(capture.index));
+                }
+            });
+
+            std::vector<std::uint32_t> tailCalls;
+            for (const auto& stmt : interpreter.tailCalls) {
+                auto id = stmts.find(stmt.get());
+                if (id != stmts.end()) tailCalls.push_back(id->second);
+            }
+            raw(static_cast<std::uint32_t>(tailCalls.size()));
+            for (std::uint32_t id : tailCalls) raw(id);
+        }
+};
+
+// reads back what ProgramWriter wrote. The side tables are held until resolve(), so a file that turns out to be
+// bad halfway through never leaves anything in the Interpreter
+class ProgramReader: public ProgramFile {
+    std::vector<std::pair<std::shared_ptr<Expr>, Interpreter::Local>> locals, receivers;
+    std::vector<std::pair<std::shared_ptr<Stmt>, int>> slots;
+    std::vector<std::pair<std::shared_ptr<Stmt>, Interpreter::ScopeLayout>> layouts;
+    std::vector<std::pair<std::shared_ptr<Stmt>, std::vector<Interpreter::Capture>>> captures;
+    std::vector<std::shared_ptr<Stmt>> tailCalls;
+
+    public:
+        const char* at;
+        const char* end;
+        std::vector<std::shared_ptr<Expr>> exprs;
+        std::vector<std::shared_ptr<Stmt>> stmts;
+        std::unordered_map<std::string, std::shared_ptr<LoxString>> strings; // shared again, like the Scanner does
+
+        ProgramReader (const std::string& in) : at{in.data()}, end{in.data() + in.size()} {}
+
+        template <typename T>
+        T raw () {
+            if (static_cast<size_t>(end - at) < sizeof(T)) throw Corrupt{};
+            T value;
+            std::memcpy(&value, at, sizeof value);
+            at += sizeof value;
+            return value;
+        }
+
+        std::uint32_t count () {
+            std::uint32_t n = raw<std::uint32_t>();
+            if (n > static_cast<size_t>(end - at)) throw Corrupt{}; // every element takes at least a byte
+            return n;
+        }
+
+        std::string text () {
+            std::uint32_t size = count();
+            std::string s{at, size};
+            at += size;
+            return s;
+        }
+
+        std::any value () {
+            switch (raw<ValueTag>()) {
+                case ValueTag::EMPTY: return {};
+                case ValueTag::NIL: return nullptr;
+                case ValueTag::BOOL: return raw<std::uint8_t>() != 0;
+                case ValueTag::NUMBER: return raw<double>();
+                case ValueTag::STRING: {
+                    std::string characters = text();
+                    std::shared_ptr<LoxString>& string = strings[characters];
+                    if (string == nullptr) string = std::make_shared<LoxString>(std::move(characters));
+                    return string;
+                }
+            }
+            throw Corrupt{};
+        }
+
+        Token token () {
+            auto type = static_cast<TokenType>(raw<std::uint8_t>());
+            std::string lexeme = text();
+            std::any literal = value();
+            int line = raw<std::int32_t>();
+            return Token{type, std::move(lexeme), std::move(literal), line};
+        }
+
+        std::vector<Token> tokens () {
+            std::vector<Token> tokens;
+            for (std::uint32_t n = count(); n > 0; --n) tokens.push_back(token());
+            return tokens;
+        }
+
+        // the tag of the next node, or nullptr/the earlier node for NONE and REF
+        template <typename Node>
+        bool seen (std::vector<std::shared_ptr<Node>>& nodes, std::uint8_t tag, std::shared_ptr<Node>& node) {
+            if (tag == NONE) return true;
+            if (tag != REF) return false;
+            std::uint32_t id = raw<std::uint32_t>();
+            if (id >= nodes.size() || nodes[id] == nullptr) throw Corrupt{}; // a node can't contain itself
+            node = nodes[id];
+            return true;
+        }
+
+        template <typename Node, typename Base>
+        std::shared_ptr<Node> as (std::shared_ptr<Base> node) {
+            if (node == nullptr) return nullptr;
+            auto cast = std::dynamic_pointer_cast<Node>(node);
+            if (cast == nullptr) throw Corrupt{};
+            return cast;
+        }
+
+        std::vector<std::shared_ptr<Expr>> exprList () {
+            std::vector<std::shared_ptr<Expr>> list;
+            for (std::uint32_t n = count(); n > 0; --n) list.push_back(required(readExpr()));
+            return list;
+        }
+
+        std::vector<std::shared_ptr<Stmt>> stmtList () {
+            std::vector<std::shared_ptr<Stmt>> list;
+            for (std::uint32_t n = count(); n > 0; --n) list.push_back(required(readStmt()));
+            return list;
+        }
+
+        template <typename Node>
+        static std::shared_ptr<Node> required (std::shared_ptr<Node> node) {
+            if (node == nullptr) throw Corrupt{};
+            return node;
+        }
+
+        // fields are read into locals first, the order a constructor's arguments are evaluated in isn't fixed
+        std::shared_ptr<Expr> readExpr () {
+            auto tag = raw<std::uint8_t>();
+            std::shared_ptr<Expr> expr;
+            if (seen(exprs, tag, expr)) return expr;
+
+            size_t id = exprs.size();
+            exprs.emplace_back(); // numbered before its children, like the Writer does
+
+            switch (static_cast<ExprKind>(tag)) {
+                case ExprKind::Assign: {
+                    Token name = token();
+                    auto value = required(readExpr());
+                    expr = std::make_shared<Assign>(std::move(name), value);
+                    break;
+                }
+                case ExprKind::Binary: {
+                    auto left = required(readExpr());
+                    Token op = token();
+                    auto right = required(readExpr());
+                    expr = std::make_shared<Binary>(left, std::move(op), right);
+                    break;
+                }
+                case ExprKind::Call: {
+                    auto callee = required(readExpr());
+                    Token paren = token();
+                    expr = std::make_shared<Call>(callee, std::move(paren), exprList());
+                    break;
+                }
+                case ExprKind::Invoke: {
+                    auto object = required(readExpr());
+                    Token name = token();
+                    Token paren = token();
+                    expr = std::make_shared<Invoke>(object, std::move(name), std::move(paren), exprList());
+                    break;
+                }
+                case ExprKind::GET: {
+                    auto object = required(readExpr());
+                    expr = std::make_shared<GET>(object, token());
+                    break;
+                }
+                case ExprKind::Grouping: expr = std::make_shared<Grouping>(required(readExpr())); break;
+                case ExprKind::Literal: expr = std::make_shared<Literal>(value()); break;
+                case ExprKind::SET: {
+                    auto object = required(readExpr());
+                    Token name = token();
+                    auto value = required(readExpr());
+                    expr = std::make_shared<SET>(object, std::move(name), value);
+                    break;
+                }
+                case ExprKind::SUPER: {
+                    Token keyword = token();
+                    expr = std::make_shared<SUPER>(std::move(keyword), token());
+                    break;
+                }
+                case ExprKind::THIS: expr = std::make_shared<THIS>(token()); break;
+                case ExprKind::Logical: {
+                    auto left = required(readExpr());
+                    Token op = token();
+                    auto right = required(readExpr());
+                    expr = std::make_shared<Logical>(left, std::move(op), right);
+                    break;
+                }
+                case ExprKind::Unary: {
+                    Token op = token();
+                    expr = std::make_shared<Unary>(std::move(op), required(readExpr()));
+                    break;
+                }
+                case ExprKind::Variable: expr = std::make_shared<Variable>(token()); break;
+                default: throw Corrupt{};
+            }
+
+            exprs[id] = expr;
+            return expr;
+        }
+
+        std::shared_ptr<Stmt> readStmt () {
+            auto tag = raw<std::uint8_t>();
+            std::shared_ptr<Stmt> stmt;
+            if (seen(stmts, tag, stmt)) return stmt;
+
+            size_t id = stmts.size();
+            stmts.emplace_back();
+
+            switch (static_cast<StmtKind>(tag)) {
+                case StmtKind::Block: stmt = std::make_shared<Block>(stmtList()); break;
+                case StmtKind::CLASS: {
+                    Token name = token();
+                    auto superclass = as<Variable>(readExpr());
+                    std::vector<std::shared_ptr<Function>> methods;
+                    for (std::uint32_t n = count(); n > 0; --n) methods.push_back(required(as<Function>(readStmt())));
+                    stmt = std::make_shared<CLASS>(std::move(name), superclass, std::move(methods));
+                    break;
+                }
+                case StmtKind::Expression: stmt = std::make_shared<Expression>(required(readExpr())); break;
+                case StmtKind::FOR: {
+                    auto initializer = readStmt();
+                    auto condition = readExpr();
+                    auto increment = readExpr();
+                    auto body = required(readStmt());
+                    stmt = std::make_shared<FOR>(initializer, condition, increment, body);
+                    break;
+                }
+                case StmtKind::Function: {
+                    Token name = token();
+                    std::vector<Token> params = tokens();
+                    stmt = std::make_shared<Function>(std::move(name), std::move(params), stmtList());
+                    break;
+                }
+                case StmtKind::IF: {
+                    auto condition = required(readExpr());
+                    auto thenBranch = required(readStmt());
+                    auto elseBranch = readStmt();
+                    auto node = std::make_shared<IF>(condition, thenBranch, elseBranch);
+                    if (raw<std::uint8_t>() != 0) node->test = as<Binary>(condition).get();
+                    stmt = node;
+                    break;
+                }
+                case StmtKind::PRINT: stmt = std::make_shared<PRINT>(required(readExpr())); break;
+                case StmtKind::RETURN: {
+                    Token keyword = token();
+                    stmt = std::make_shared<RETURN>(std::move(keyword), readExpr());
+                    break;
+                }
+                case StmtKind::VAR: {
+                    Token name = token();
+                    stmt = std::make_shared<VAR>(std::move(name), readExpr());
+                    break;
+                }
+                case StmtKind::WHILE: {
+                    auto condition = required(readExpr());
+                    auto body = required(readStmt());
+                    auto node = std::make_shared<WHILE>(condition, body);
+                    if (raw<std::uint8_t>() != 0) node->test = as<Binary>(condition).get();
+                    stmt = node;
+                    break;
+                }
+                default: throw Corrupt{};
+            }
+
+            stmts[id] = stmt;
+            return stmt;
+        }
+
+        template <typename Node>
+        const std::shared_ptr<Node>& node (const std::vector<std::shared_ptr<Node>>& nodes) {
+            std::uint32_t id = raw<std::uint32_t>();
+            if (id >= nodes.size()) throw Corrupt{};
+            return nodes[id];
+        }
+
+        Interpreter::Local local () {
+            int slot = raw<std::int32_t>();
+            int upvalue = raw<std::int32_t>();
+            return Interpreter::Local{slot, upvalue};
+        }
+
+        void tables () {
+            for (std::uint32_t n = count(); n > 0; --n) {
+                const auto& expr = node(exprs);
+                locals.emplace_back(expr, local());
+            }
+            for (std::uint32_t n = count(); n > 0; --n) {
+                const auto& expr = node(exprs);
+                receivers.emplace_back(expr, local());
+            }
+            for (std::uint32_t n = count(); n > 0; --n) {
+                const auto& stmt = node(stmts);
+                slots.emplace_back(stmt, raw<std::int32_t>());
+            }
+            for (std::uint32_t n = count(); n > 0; --n) {
+                const auto& stmt = node(stmts);
+                bool captured = raw<std::uint8_t>() != 0;
+                int slotStart = raw<std::int32_t>();
+                int slotEnd = raw<std::int32_t>();
+                layouts.emplace_back(stmt, Interpreter::ScopeLayout{captured, slotStart, slotEnd});
+            }
+            for (std::uint32_t n = count(); n > 0; --n) {
+                const auto& stmt = node(stmts);
+                std::vector<Interpreter::Capture> upvalues;
+                for (std::uint32_t m = count(); m > 0; --m) {
+                    bool isLocal = raw<std::uint8_t>() != 0;
+                    upvalues.push_back(Interpreter::Capture{isLocal, raw<std::int32_t>()});
+                }
+                captures.emplace_back(stmt, std::move(upvalues));
+            }
+            for (std::uint32_t n = count(); n > 0; --n) tailCalls.push_back(node(stmts));
+        }
+
+        void resolve (Interpreter& interpreter) {
+            for (auto& [expr, local] : locals) interpreter.resolve(expr, local);
+            for (auto& [expr, local] : receivers) interpreter.resolveReceiver(expr, local);
+            for (auto& [stmt, slot] : slots) interpreter.resolve(stmt, slot);
+            for (auto& [stmt, layout] : layouts)
+                interpreter.resolveScope(stmt, layout.captured, layout.slotStart, layout.slotEnd);
+            for (auto& [stmt, upvalues] : captures) interpreter.resolveCaptures(stmt, std::move(upvalues));
+            for (auto& stmt : tailCalls) interpreter.resolveTailCall(stmt);
+        }
+};
+
+class ProgramCache: public ProgramFile {
+    static constexpr char MAGIC[4] = {'L', 'O', 'X', 'C'};
+    static constexpr std::uint32_t FORMAT = 2; // bump when the layout above or a node's fields change
+
+    Interpreter& interpreter;
+    std::filesystem::path directory;
+    std::string build; // whatever else has to match besides the source
+
+    std::uint64_t key (std::string_view src) const { return hash(src, hash(build)); }
+
+    std::filesystem::path pathFor (std::uint64_t key) const {
+        char name[32];
+        std::snprintf(name, sizeof name, "%016llx.loxc", static_cast<unsigned long long>(key));
+        return directory / name;
+    }
+
+    public:
+        ProgramCache (Interpreter& interpreter, std::filesystem::path directory, std::string build)
+            : interpreter{interpreter}, directory{std::move(directory)}, build{std::move(build)} {}
+
+        // fills statements (and the Interpreter's side tables) with what was stored for src, false when there's
+        // nothing usable
+        bool load (std::string_view src, std::vector<std::shared_ptr<Stmt>>& statements) {
+            std::string in;
+            if (!read(pathFor(key(src)), in)) return false;
+
+            try {
+                ProgramReader reader{in};
+                char magic[sizeof MAGIC];
+                for (char& c : magic) c = reader.raw<char>();
+                if (std::memcmp(magic, MAGIC, sizeof MAGIC) != 0 || reader.raw<std::uint32_t>() != FORMAT) return false;
+                // a second hash of the source, with another seed, so a collision on the file name reads as a miss
+                if (reader.raw<std::uint64_t>() != src.size() || reader.raw<std::uint64_t>() != hash(src)) return false;
+
+                // what the optimizer did when it was stored, so --stats reads the same on a hit
+                OptimizerStats stats;
+                for (long long* count : {&stats.folded, &stats.propagated, &stats.removed, &stats.fused}) *count = reader.raw<std::int64_t>();
+
+                std::vector<std::shared_ptr<Stmt>> program = reader.stmtList();
+                reader.tables();
+                if (reader.at != reader.end) return false;
+
+                reader.resolve(interpreter);
+                statements = std::move(program);
+                optimizerStats.folded += stats.folded;
+                optimizerStats.propagated += stats.propagated;
+                optimizerStats.removed += stats.removed;
+                optimizerStats.fused += stats.fused;
+                return true;
+            } catch (const Corrupt&) {
+                return false;
+            }
+        }
+
+        // failing to write is never an error, the script just isn't cached. src is the only program compiled so far,
+        // so optimizerStats are all its own
+        void store (std::string_view src, const std::vector<std::shared_ptr<Stmt>>& statements) {
+            ProgramWriter writer;
+            try {
+                writer.out.append(MAGIC, sizeof MAGIC);
+                writer.raw(FORMAT);
+                writer.raw(static_cast<std::uint64_t>(src.size()));
+                writer.raw(hash(src));
+                for (long long count : {optimizerStats.folded, optimizerStats.propagated, optimizerStats.removed, optimizerStats.fused}) {
+                    writer.raw(static_cast<std::int64_t>(count));
+                }
+                writer.list(statements);
+                writer.tables(interpreter);
+            } catch (const Unsupported&) {
+                return;
+            }
+            write(pathFor(key(src)), writer.out);
+        }
+};
@@ -7,12 +7,14 @@
 #include <unordered_map> 
 #include <utility>
 
+#include "Allocations.hpp"
 #include "Error.hpp"
 #include "Token.hpp"
 
-class Environment: public std::enable_shared_from_this<Environment> {
+class Environment: public std::enable_shared_from_this<Environment>, Counted<Environment, AllocationKind::ENVIRONMENT> {
     private:
         friend class Interpreter;
+        friend class HeapSnapshot; // added for snapshots, writes out every global
         std::unordered_map<std::string, std::any> values;
         std::shared_ptr<Environment> enclosing;
 
@@ -24,21 +26,8 @@ class Environment: public std::enable_shared_from_this<Environment> {
         // var definition that binds a name to a val
         void define (const std::string& name, std::any val) { values[name] = std::move(val); } 
 
-        // added in ch11
-        std::shared_ptr<Environment> ancestor (int distance) {
-            std::shared_ptr<Environment> environment = shared_from_this();
-            for (int i = 0; i < distance; ++i) environment = environment->enclosing; 
-
-            return environment;
-        }
-
-        // added in ch11
-        std::any getAt (int distance, const std::string& name) {
-            return ancestor(distance)->values[name];
-        }
-
         // a way to look up var once defined
-        std::any get (const Token& name) {
+        const std::any& get (const Token& name) {
             auto grabMe = values.find(name.lexeme);
             if (grabMe != values.end()) return grabMe->second;
 
@@ -47,9 +36,13 @@ class Environment: public std::enable_shared_from_this<Environment> {
             throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
         }
 
-        // added in ch11
-        void assignAt (int distance, const Token& name, std::any value) {
-            ancestor(distance)->values[name.lexeme] = std::move(value);
+        // added for self-specializing nodes... where a variable's value lives, so a node can hang on to it. Values
+        // never move once defined (unordered_map nodes stay put and nothing is ever erased)
+        std::any* find (const std::string& name) {
+            auto grabMe = values.find(name);
+            if (grabMe != values.end()) return &grabMe->second;
+            if (enclosing != nullptr) return enclosing->find(name);
+            return nullptr;
         }
 
         void assign (const Token& name, std::any value) {
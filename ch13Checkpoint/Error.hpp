@@ -5,6 +5,7 @@
 #include <iostream>
 #include <string_view>
 
+#include "Output.hpp"
 #include "RuntimeError.hpp"
 #include "Token.hpp"
 
@@ -13,6 +14,7 @@ inline bool hadRuntimeError = false; // add in ch07
 
 // Declare functions as inline to avoid multiple definitions
 inline void report(int line, std::string_view where, std::string_view message) {
+    output.flush(); // so what was printed before the error shows up before it
     std::cerr << "[line " << line << "] Error" << where << ": " << message << "\n";
     hadError = true;
 }
@@ -28,6 +30,7 @@ inline void error(int line, std::string_view message) {
 
 // added in ch07
 inline void runtimeError(const RuntimeError& error) {
+    output.flush();
     std::cerr << error.what() << "\n" << "[line " << error.token.line << "]" << "\n";
     hadRuntimeError = true;
 }
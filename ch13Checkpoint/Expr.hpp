@@ -1,15 +1,19 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
+#include "Allocations.hpp"
 #include "Token.hpp"
 
+#include "NodeState.hpp"
 
 struct Assign;
 struct Binary;
 struct Call;
+struct Invoke;
 struct GET;
 struct Grouping;
 struct Literal;
@@ -24,6 +28,7 @@ struct ExprVisitor {
 	virtual std::any visitAssignExpr(std::shared_ptr<Assign> expr) = 0;
 	virtual std::any visitBinaryExpr(std::shared_ptr<Binary> expr) = 0;
 	virtual std::any visitCallExpr(std::shared_ptr<Call> expr) = 0;
+	virtual std::any visitInvokeExpr(std::shared_ptr<Invoke> expr) = 0;
 	virtual std::any visitGETExpr(std::shared_ptr<GET> expr) = 0;
 	virtual std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) = 0;
 	virtual std::any visitLiteralExpr(std::shared_ptr<Literal> expr) = 0;
@@ -36,13 +41,31 @@ struct ExprVisitor {
 	virtual ~ExprVisitor() = default;
 };
 
+enum class ExprKind : std::uint8_t {
+	Assign,
+	Binary,
+	Call,
+	Invoke,
+	GET,
+	Grouping,
+	Literal,
+	SET,
+	SUPER,
+	THIS,
+	Logical,
+	Unary,
+	Variable,
+};
+
 struct Expr {
+	explicit Expr(ExprKind kind) : kind{kind} {}
 	virtual std::any accept(ExprVisitor& visitor) = 0;
+	const ExprKind kind;
 };
 
-struct Assign: Expr, public std::enable_shared_from_this<Assign> {
+struct Assign: Expr, public std::enable_shared_from_this<Assign>, Counted<Assign, AllocationKind::AST_NODE> {
   Assign(Token name, std::shared_ptr<Expr> value)
-    : name{std::move(name)}, value{std::move(value)}
+    : Expr{ExprKind::Assign}, name{std::move(name)}, value{std::move(value)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -51,11 +74,12 @@ struct Assign: Expr, public std::enable_shared_from_this<Assign> {
 
 	const Token name;
 	const std::shared_ptr<Expr> value;
+	VariableCache cache;
 };
 
-struct Binary: Expr, public std::enable_shared_from_this<Binary> {
+struct Binary: Expr, public std::enable_shared_from_this<Binary>, Counted<Binary, AllocationKind::AST_NODE> {
   Binary(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-    : left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
+    : Expr{ExprKind::Binary}, left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -65,11 +89,13 @@ struct Binary: Expr, public std::enable_shared_from_this<Binary> {
 	const std::shared_ptr<Expr> left;
 	const Token op;
 	const std::shared_ptr<Expr> right;
+	BinaryState state = BinaryState::UNSPECIALIZED;
+	BinaryOperands operands;
 };
 
-struct Call: Expr, public std::enable_shared_from_this<Call> {
+struct Call: Expr, public std::enable_shared_from_this<Call>, Counted<Call, AllocationKind::AST_NODE> {
   Call(std::shared_ptr<Expr> callee, Token paren, std::vector<std::shared_ptr<Expr>> arguments)
-    : callee{std::move(callee)}, paren{std::move(paren)}, arguments{std::move(arguments)}
+    : Expr{ExprKind::Call}, callee{std::move(callee)}, paren{std::move(paren)}, arguments{std::move(arguments)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -81,9 +107,24 @@ struct Call: Expr, public std::enable_shared_from_this<Call> {
 	const std::vector<std::shared_ptr<Expr>> arguments;
 };
 
-struct GET: Expr, public std::enable_shared_from_this<GET> {
+struct Invoke: Expr, public std::enable_shared_from_this<Invoke>, Counted<Invoke, AllocationKind::AST_NODE> {
+  Invoke(std::shared_ptr<Expr> object, Token name, Token paren, std::vector<std::shared_ptr<Expr>> arguments)
+    : Expr{ExprKind::Invoke}, object{std::move(object)}, name{std::move(name)}, paren{std::move(paren)}, arguments{std::move(arguments)}
+  {}
+
+	std::any accept(ExprVisitor& visitor) override {
+		return visitor.visitInvokeExpr(shared_from_this());
+  }
+
+	const std::shared_ptr<Expr> object;
+	const Token name;
+	const Token paren;
+	const std::vector<std::shared_ptr<Expr>> arguments;
+};
+
+struct GET: Expr, public std::enable_shared_from_this<GET>, Counted<GET, AllocationKind::AST_NODE> {
   GET(std::shared_ptr<Expr> object, Token name)
-    : object{std::move(object)}, name{std::move(name)}
+    : Expr{ExprKind::GET}, object{std::move(object)}, name{std::move(name)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -94,9 +135,9 @@ struct GET: Expr, public std::enable_shared_from_this<GET> {
 	const Token name;
 };
 
-struct Grouping: Expr, public std::enable_shared_from_this<Grouping> {
+struct Grouping: Expr, public std::enable_shared_from_this<Grouping>, Counted<Grouping, AllocationKind::AST_NODE> {
   Grouping(std::shared_ptr<Expr> expression)
-    : expression{std::move(expression)}
+    : Expr{ExprKind::Grouping}, expression{std::move(expression)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -106,9 +147,9 @@ struct Grouping: Expr, public std::enable_shared_from_this<Grouping> {
 	const std::shared_ptr<Expr> expression;
 };
 
-struct Literal: Expr, public std::enable_shared_from_this<Literal> {
+struct Literal: Expr, public std::enable_shared_from_this<Literal>, Counted<Literal, AllocationKind::AST_NODE> {
   Literal(std::any value)
-    : value{std::move(value)}
+    : Expr{ExprKind::Literal}, value{std::move(value)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -118,9 +159,9 @@ struct Literal: Expr, public std::enable_shared_from_this<Literal> {
 	const std::any value;
 };
 
-struct SET: Expr, public std::enable_shared_from_this<SET> {
+struct SET: Expr, public std::enable_shared_from_this<SET>, Counted<SET, AllocationKind::AST_NODE> {
   SET(std::shared_ptr<Expr> object, Token name, std::shared_ptr<Expr> value)
-    : object{std::move(object)}, name{std::move(name)}, value{std::move(value)}
+    : Expr{ExprKind::SET}, object{std::move(object)}, name{std::move(name)}, value{std::move(value)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -132,9 +173,9 @@ struct SET: Expr, public std::enable_shared_from_this<SET> {
 	const std::shared_ptr<Expr> value;
 };
 
-struct SUPER: Expr, public std::enable_shared_from_this<SUPER> {
+struct SUPER: Expr, public std::enable_shared_from_this<SUPER>, Counted<SUPER, AllocationKind::AST_NODE> {
   SUPER(Token keyword, Token method)
-    : keyword{std::move(keyword)}, method{std::move(method)}
+    : Expr{ExprKind::SUPER}, keyword{std::move(keyword)}, method{std::move(method)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -145,9 +186,9 @@ struct SUPER: Expr, public std::enable_shared_from_this<SUPER> {
 	const Token method;
 };
 
-struct THIS: Expr, public std::enable_shared_from_this<THIS> {
+struct THIS: Expr, public std::enable_shared_from_this<THIS>, Counted<THIS, AllocationKind::AST_NODE> {
   THIS(Token keyword)
-    : keyword{std::move(keyword)}
+    : Expr{ExprKind::THIS}, keyword{std::move(keyword)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -155,11 +196,12 @@ struct THIS: Expr, public std::enable_shared_from_this<THIS> {
   }
 
 	const Token keyword;
+	VariableCache cache;
 };
 
-struct Logical: Expr, public std::enable_shared_from_this<Logical> {
+struct Logical: Expr, public std::enable_shared_from_this<Logical>, Counted<Logical, AllocationKind::AST_NODE> {
   Logical(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-    : left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
+    : Expr{ExprKind::Logical}, left{std::move(left)}, op{std::move(op)}, right{std::move(right)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -171,9 +213,9 @@ struct Logical: Expr, public std::enable_shared_from_this<Logical> {
 	const std::shared_ptr<Expr> right;
 };
 
-struct Unary: Expr, public std::enable_shared_from_this<Unary> {
+struct Unary: Expr, public std::enable_shared_from_this<Unary>, Counted<Unary, AllocationKind::AST_NODE> {
   Unary(Token op, std::shared_ptr<Expr> right)
-    : op{std::move(op)}, right{std::move(right)}
+    : Expr{ExprKind::Unary}, op{std::move(op)}, right{std::move(right)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -184,9 +226,9 @@ struct Unary: Expr, public std::enable_shared_from_this<Unary> {
 	const std::shared_ptr<Expr> right;
 };
 
-struct Variable: Expr, public std::enable_shared_from_this<Variable> {
+struct Variable: Expr, public std::enable_shared_from_this<Variable>, Counted<Variable, AllocationKind::AST_NODE> {
   Variable(Token name)
-    : name{std::move(name)}
+    : Expr{ExprKind::Variable}, name{std::move(name)}
   {}
 
 	std::any accept(ExprVisitor& visitor) override {
@@ -194,5 +236,6 @@ struct Variable: Expr, public std::enable_shared_from_this<Variable> {
   }
 
 	const Token name;
+	VariableCache cache;
 };
 
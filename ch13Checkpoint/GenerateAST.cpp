@@ -90,8 +90,16 @@ void defineVisitor(std::ofstream& writer, std::string_view baseName, const std::
 }
 
 // Function to define a class type with constructor, visitor, and fields.
+// updated for self-specializing nodes... anything after a '|' is per-node state the interpreter rewrites as it runs,
+// so it isn't const and is left out of the constructor
 void defineType(std::ofstream& writer, std::string_view baseName, std::string_view structName, std::string_view fieldList) {
-    writer << "struct " << structName << ": " << baseName << ", public std::enable_shared_from_this<" << structName << "> {\n";
+    std::vector<std::string_view> parts = split(fieldList, " | ");
+    fieldList = trim(parts[0]);
+
+    // writer << "struct " << structName << ": " << baseName << ", public std::enable_shared_from_this<" << structName << "> {\n";
+    // updated for allocation accounting... every node counts itself
+    writer << "struct " << structName << ": " << baseName << ", public std::enable_shared_from_this<" << structName << ">, "
+           << "Counted<" << structName << ", AllocationKind::AST_NODE> {\n";
 
     writer << "  " << structName << "(";
 
@@ -100,8 +108,11 @@ void defineType(std::ofstream& writer, std::string_view baseName, std::string_vi
 
     for (int i = 1; i < fields.size(); ++i) { writer << ", " << fixPtr(fields[i]); }
 
+    // writer << ")\n"
+    //        << "    : ";
+    // updated for direct dispatch... the base is told which kind of node it is
     writer << ")\n"
-           << "    : ";
+           << "    : " << baseName << "{" << baseName << "Kind::" << structName << "}, ";
 
     std::string_view name = split(fields[0], " ")[1];
     writer << name << "{std::move(" << name << ")}";
@@ -125,6 +136,8 @@ void defineType(std::ofstream& writer, std::string_view baseName, std::string_vi
         writer << "\tconst " << fixPtr(field) << ";\n";
     }
 
+    for (size_t i = 1; i < parts.size(); ++i) { writer << "\t" << trim(parts[i]) << ";\n"; }
+
     writer << "};\n\n";
 }
 
@@ -136,12 +149,15 @@ void defineAst(const std::string& outputDir, const std::string& baseName, const
     writer << "#pragma once\n"
                 "\n"
                 "#include <any>\n"
+                "#include <cstdint>\n"
                 "#include <memory>\n"
                 "#include <utility>\n"
                 "#include <vector>\n"
+                "#include \"Allocations.hpp\"\n"
                 "#include \"Token.hpp\"\n"
                 "\n";
 
+    if (baseName == "Expr") writer << "#include \"NodeState.hpp\"\n"; // added for self-specializing nodes
     if (baseName == "Stmt") writer << "#include \"Expr.hpp\"\n";
     writer << "\n";
 
@@ -153,10 +169,24 @@ void defineAst(const std::string& outputDir, const std::string& baseName, const
     writer << "\n";
     defineVisitor(writer, baseName, types);
 
+    // added for direct dispatch... every node carries its kind, so the Interpreter can jump straight to the code for
+    // it instead of going through accept() and then the visitor's vtable
+    writer << "\n"
+              "enum class " << baseName << "Kind : std::uint8_t {\n";
+    for (std::string_view type : types) writer << "\t" << trim(split(type, ": ")[0]) << ",\n";
+    writer << "};\n";
+
+    // writer << "\n"
+    //             "struct " << baseName << " {\n"
+    //             "\tvirtual std::any accept(" << baseName <<
+    //             "Visitor& visitor) = 0;\n"
+    //             "};\n\n";
     writer << "\n"
                 "struct " << baseName << " {\n"
+                "\texplicit " << baseName << "(" << baseName << "Kind kind) : kind{kind} {}\n"
                 "\tvirtual std::any accept(" << baseName <<
                 "Visitor& visitor) = 0;\n"
+                "\tconst " << baseName << "Kind kind;\n"
                 "};\n\n";
 
     for (std::string_view type : types) {
@@ -174,19 +204,22 @@ int main(int argc, char* argv[]) {
     std::string outputDir = argv[1];
 
     defineAst(outputDir, "Expr", { // updated in ch12
-        "Assign   : Token name, Expr* value",
-        "Binary   : Expr* left, Token op, Expr* right",
+        "Assign   : Token name, Expr* value | VariableCache cache", // cache updated for self-specializing nodes
+        "Binary   : Expr* left, Token op, Expr* right | BinaryState state = BinaryState::UNSPECIALIZED"
+                  " | BinaryOperands operands", // operands added for superinstructions
         "Call     : Expr* callee, Token paren,"
                   " std::vector<Expr*> arguments", // added in ch10
+        "Invoke   : Expr* object, Token name, Token paren,"
+                  " std::vector<Expr*> arguments", // added for superinstructions, a Call on a GET
         "GET      : Expr* object, Token name", // added in ch12
         "Grouping : Expr* expression",
         "Literal  : std::any value",
         "SET      : Expr* object, Token name, Expr* value", // added in ch12
         "SUPER    : Token keyword, Token method", // added in ch13
-        "THIS     : Token keyword", // added in ch12
+        "THIS     : Token keyword | VariableCache cache", // added in ch12
         "Logical  : Expr* left, Token op, Expr* right", // added in ch09
         "Unary    : Token op, Expr* right",
-        "Variable : Token name"
+        "Variable : Token name | VariableCache cache"
     });
 
     defineAst(outputDir, "Stmt", { // updated in ch12
@@ -194,13 +227,15 @@ int main(int argc, char* argv[]) {
         "CLASS      : Token name, Variable* superclass,"
                     " std::vector<Function*> methods", // updated in ch13
         "Expression : Expr* expression",
+        "FOR        : Stmt* initializer, Expr* condition, Expr* increment,"
+                    " Stmt* body | CountedLoop counted", // added for fused loops
         "Function   : Token name, std::vector<Token> params,"
                     " std::vector<Stmt*> body", // added in ch10
         "IF         : Expr* condition, Stmt* thenBranch,"
-                    " Stmt* elseBranch", // added in ch09... similar case as print and var
+                    " Stmt* elseBranch | Binary* test = nullptr", // added in ch09... similar case as print and var
         "PRINT      : Expr* expression", // since my token types are Print and Var, I had a conflict... So, I changed these instead of my types so they would match my format
         "RETURN     : Token keyword, Expr* value", // added in ch10
         "VAR        : Token name, Expr* initializer",
-        "WHILE      : Expr* condition, Stmt* body"
+        "WHILE      : Expr* condition, Stmt* body | Binary* test = nullptr" // test added for superinstructions
     });
 }
\ No newline at end of file
@@ -1,14 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <any>
-#include <chrono>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
 #include <iostream>
 #include <map> // added in ch12
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
-// #include <unordered_map>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility> 
 
 #include "Environment.hpp"
@@ -18,38 +25,133 @@
 #include "LoxClass.hpp"
 #include "LoxFunction.hpp"
 #include "LoxInstance.hpp"
+#include "LoxNative.hpp"
 #include "LoxReturn.hpp"
+#include "LoxString.hpp"
+#include "Natives.hpp"
+#include "Tracer.hpp"
+#include "Output.hpp"
 #include "RuntimeError.hpp"
 #include "Stmt.hpp"
+#include "Upvalue.hpp"
 
 // note: I restructured the class to match the book's implementation... The author had it setup a certain way for a
 // reason, and I believe that was also causing me issues in ch12
 
-// native clock added in ch10
-class CLOCK: public LoxCallable {
-    public:
-        int arity() override { return 0; }
-
-        std::any call (Interpreter& interpreter, std::vector<std::any> arguments) override {
-            auto time = std::chrono::system_clock::now().time_since_epoch();
-            return std::chrono::duration<double>{time}.count() / 1000.0;
-        }
-
-        std::string toString() override { return "<native fn>"; }
-};
-
 // updated in ch08 to include inheritance from StmtVisitor
 class Interpreter: public ExprVisitor, public StmtVisitor {
     friend class LoxFunction; // added in ch10
+    friend class LoxNative;
+    friend class Sampler;
+    friend class Optimizer; // folds constants by evaluating them
+    friend class ProgramWriter; // writes out the side tables
     public: std::shared_ptr<Environment> globals{new Environment}; // added in ch10
 
+    // added for escape analysis... where the resolver decided a local lives
+    struct Local {
+        int slot;    // >= 0 means a stack slot in the current frame
+        int upvalue; // otherwise, which of the running closure's upvalues it is... updated for upvalue closures
+    };
+
+    // the slots a block or function body owns, and whether a closure captured one of them (so they need closing)
+    struct ScopeLayout {
+        bool captured;
+        int slotStart;
+        int slotEnd;
+    };
+
+    // added for upvalue closures... clox's upvalue descriptor: either a slot of the enclosing frame or one of the
+    // enclosing function's own upvalues
+    struct Capture {
+        bool isLocal;
+        int index;
+    };
+
+    private:
+    // std::shared_ptr<Environment> environment = globals; // added in ch10... only globals need an Environment now
+    std::unordered_map<std::shared_ptr<Expr>, Local> locals; // added in ch11... updated for escape analysis
+    std::unordered_map<std::shared_ptr<Expr>, Local> receivers; // where 'this' is for each super expression
+    std::unordered_map<std::shared_ptr<Stmt>, int> slots; // declarations that live in a stack slot
+    std::unordered_map<std::shared_ptr<Stmt>, ScopeLayout> layouts;
+    std::unordered_map<std::shared_ptr<Stmt>, std::vector<Capture>> captures;
+    std::unordered_set<std::shared_ptr<Stmt>> tailCalls; // returns whose value is a call made in the returning frame
+
+    // every local lives here instead of in an Environment, so entering a scope never allocates. Slots are relative
+    // to frameBase, and stackTop is the first slot the current frame isn't using. The stack never grows past its
+    // reserved capacity because open upvalues point straight into it
+    static constexpr size_t STACK_MAX = 1 << 18;
+    std::vector<std::any> stack;
+    size_t frameBase = 0;
+    size_t stackTop = 0;
+
+    std::vector<std::shared_ptr<Upvalue>>* upvalues = nullptr; // the running closure's
+    std::vector<std::shared_ptr<Upvalue>> openUpvalues; // sorted by slot, so closing only looks at the back
+
+    // added for the sampling profiler... the Lox functions currently running, innermost last. A SIGPROF handler reads
+    // this at any moment, so a frame is written before callDepth counts it. Every call takes at least one stack
+    // slot, so STACK_MAX entries is always enough (they're left uninitialized, untouched pages cost nothing)
+    // updated for the frame stack... each frame also knows the call expression that made it, so running out of
+    // frames or slots is reported where the call is
+    struct CallFrame {
+        const Function* function;
+        const Token* callSite;
+    };
+    std::unique_ptr<CallFrame[]> callStack{new CallFrame[STACK_MAX]};
+    volatile std::sig_atomic_t callDepth = 0;
+    const Token* callSite = nullptr; // set by callValue() for the enterCall() that follows it
+
+    void enterCall (const Function* function) {
+        callStack[callDepth] = CallFrame{function, callSite};
+        std::atomic_signal_fence(std::memory_order_release);
+        callDepth = callDepth + 1;
+        if (tracer != nullptr) tracer->begin(function->name.lexeme, "function", function->name.line);
+    }
+
+    void leaveCall () {
+        callDepth = callDepth - 1;
+        if (tracer != nullptr) tracer->end(callStack[callDepth].function->name.lexeme, "function");
+        if (drainRequested) drainSamples(); // the sampler's ring is filling up, so fold its samples here
+    }
+
+    // set by the sampler's signal handler, which can't do the folding itself, and cleared by drainSamples()
+    volatile std::sig_atomic_t drainRequested = 0;
+    void (*drainSamples)() = nullptr;
+
+    public: Tracer* tracer = nullptr; // added for --trace, gets every call's entry and exit
+
+    // added for the frame stack... how many Lox calls can be running at once before it's a "Stack overflow." error
+    public: static constexpr size_t DEFAULT_MAX_DEPTH = 1 << 16;
+    public: size_t maxCallDepth = DEFAULT_MAX_DEPTH;
+
+    // updated for stack bounds... every Lox call also recurses on the native stack, by however much its expressions
+    // nest, so no call depth keeps that from running off the end. cLL says where the stack ends, and getting within
+    // STACK_MARGIN of it is a "Stack overflow." error too. 0 means the end isn't known and only the depth is checked
+    public: static constexpr std::uintptr_t STACK_MARGIN = 256 << 10;
+    private: std::uintptr_t stackLimit = 0;
+    public: void nativeStackEnd (std::uintptr_t end) { stackLimit = end + STACK_MARGIN; }
+
+    // added for tail calls... LoxFunction::call runs the callee in the frame it took over, after enterCall(). The
+    // profiler times each call from outside, so this tells it the frame now belongs to someone else
+    protected: virtual void tailCall (const std::any& callee) {}
+
     private:
-    std::shared_ptr<Environment> environment = globals; // added in ch10
-    std::map<std::shared_ptr<Expr>, int> locals; // added in ch11
 
     public: 
         // added in ch10
-        Interpreter () { globals->define("clock", std::shared_ptr<CLOCK>{}); }
+        Interpreter () {
+            // globals->define("clock", std::shared_ptr<CLOCK>{});
+            stack.reserve(STACK_MAX);
+            defineNative("clock", 0, clockNative);
+            defineNative("nanoClock", 0, nanoClockNative);
+            defineNative("cpuClock", 0, cpuClockNative);
+            defineNative("heapStats", 0, heapStatsNative);
+            defineNative("liveBytes", 0, liveBytesNative);
+        }
+
+        // added for native functions... the registry is just the globals, natives are values like any other
+        void defineNative (const std::string& name, int arity, NativeFunction function) {
+            globals->define(name, std::shared_ptr<LoxCallable>{std::make_shared<LoxNative>(name, arity, function)});
+        }
 
         // void interpret (std::shared_ptr<Expr> expression) { 
         //     try {
@@ -68,72 +170,200 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
             }
         }
 
-        private: 
-            std::any eval (std::shared_ptr<Expr> expr) { return expr->accept(*this); } // recursive helper to group
+        protected: // updated for the profiler, which wraps these
+            // std::any eval (std::shared_ptr<Expr> expr) { return expr->accept(*this); } // recursive helper to group
+            // void execute (std::shared_ptr<Stmt> stmt) { stmt->accept(*this); }
+
+            // updated for direct dispatch... switches on the node's ExprKind straight into this class's own visit method,
+            // which skips accept(), the visitor's vtable and the shared_from_this() in between, and lets the compiler
+            // inline the small ones. The switch compiles to a jump table already, a computed-goto table of labels timed
+            // the same. The profiler overrides the visit methods, so it still goes through accept()
+            std::any eval (const std::shared_ptr<Expr>& expr) {
+                if (nearStackEnd()) stackOverflow();
+                if (!directDispatch) return expr->accept(*this);
+                switch (expr->kind) {
+                    case ExprKind::Assign: return Interpreter::visitAssignExpr(std::static_pointer_cast<Assign>(expr));
+                    case ExprKind::Binary: return Interpreter::visitBinaryExpr(std::static_pointer_cast<Binary>(expr));
+                    case ExprKind::Call: return Interpreter::visitCallExpr(std::static_pointer_cast<Call>(expr));
+                    case ExprKind::Invoke: return Interpreter::visitInvokeExpr(std::static_pointer_cast<Invoke>(expr));
+                    case ExprKind::GET: return Interpreter::visitGETExpr(std::static_pointer_cast<GET>(expr));
+                    case ExprKind::Grouping: return Interpreter::visitGroupingExpr(std::static_pointer_cast<Grouping>(expr));
+                    case ExprKind::Literal: return Interpreter::visitLiteralExpr(std::static_pointer_cast<Literal>(expr));
+                    case ExprKind::SET: return Interpreter::visitSETExpr(std::static_pointer_cast<SET>(expr));
+                    case ExprKind::SUPER: return Interpreter::visitSUPERExpr(std::static_pointer_cast<SUPER>(expr));
+                    case ExprKind::THIS: return Interpreter::visitTHISExpr(std::static_pointer_cast<THIS>(expr));
+                    case ExprKind::Logical: return Interpreter::visitLogicalExpr(std::static_pointer_cast<Logical>(expr));
+                    case ExprKind::Unary: return Interpreter::visitUnaryExpr(std::static_pointer_cast<Unary>(expr));
+                    case ExprKind::Variable: return Interpreter::visitVariableExpr(std::static_pointer_cast<Variable>(expr));
+                }
+                return {};
+            }
+
+            // statements still go through accept(). Every return unwinds through the statements it's nested in, and the
+            // unwinder is slower through one big dispatch function than through the small accept()s, enough to cost
+            // call-heavy scripts more than the jump saves
+            void execute (const std::shared_ptr<Stmt>& stmt) {
+                if (nearStackEnd()) stackOverflow();
+                stmt->accept(*this);
+            }
+
+            // added for stack bounds... the address of a local is where the native stack is now, and it grows down
+            bool nearStackEnd () const {
+                char here;
+                return reinterpret_cast<std::uintptr_t>(&here) < stackLimit;
+            }
 
-            void execute (std::shared_ptr<Stmt> stmt) { stmt->accept(*this); }
+            // reported where the innermost call was made. Outside any call the parser already got through this much
+            // nesting on the same stack, so there's nothing deeper to stop
+            void stackOverflow () {
+                if (callDepth > 0) throw RuntimeError(*callStack[callDepth - 1].callSite, "Stack overflow.");
+            }
+
+            bool directDispatch = true;
 
         public: 
-            void resolve (std::shared_ptr<Expr> expr, int depth) { locals[expr] = depth; } // added in ch11
+            void resolve (std::shared_ptr<Expr> expr, Local local) { locals[expr] = local; } // added in ch11
+
+            void resolve (std::shared_ptr<Stmt> declaration, int slot) { slots[declaration] = slot; }
+
+            void resolveReceiver (std::shared_ptr<Expr> expr, Local local) { receivers[expr] = local; }
+
+            void resolveScope (std::shared_ptr<Stmt> scope, bool captured, int slotStart, int slotEnd) {
+                layouts[scope] = ScopeLayout{captured, slotStart, slotEnd};
+            }
+
+            void resolveCaptures (std::shared_ptr<Stmt> function, std::vector<Capture> upvalues) {
+                captures[function] = std::move(upvalues);
+            }
+
+            void resolveTailCall (std::shared_ptr<Stmt> stmt) { tailCalls.insert(stmt); } // added for tail calls
+
+            // added for the optimizer... it rebuilds nodes, so whatever the Resolver told us moves to the new one
+            void replace (const std::shared_ptr<Expr>& from, const std::shared_ptr<Expr>& to) {
+                moveEntry(locals, from, to);
+                moveEntry(receivers, from, to);
+            }
+
+            void replace (const std::shared_ptr<Stmt>& from, const std::shared_ptr<Stmt>& to) {
+                moveEntry(slots, from, to);
+                moveEntry(layouts, from, to);
+                moveEntry(captures, from, to);
+                if (tailCalls.erase(from) != 0) tailCalls.insert(to);
+            }
+
+            void forget (const std::shared_ptr<Expr>& expr) { locals.erase(expr); }
+
+        private:
+            template <typename Node, typename Value>
+            static void moveEntry (std::unordered_map<std::shared_ptr<Node>, Value>& map,
+                                   const std::shared_ptr<Node>& from, const std::shared_ptr<Node>& to) {
+                auto entry = map.find(from);
+                if (entry == map.end()) return;
+                Value value = std::move(entry->second);
+                map.erase(entry);
+                map[to] = std::move(value);
+            }
 
         // added in ch08... executes a list of stmts of the curr environment
         // moved again in ch12
-        private : void executeBlock (const std::vector<std::shared_ptr<Stmt>>& statements, std::shared_ptr<Environment> environment) {
-            std::shared_ptr<Environment> previous = this->environment;
+        // updated for upvalue closures... a function body gets a fresh frame of slots above the caller's
+        // updated for the frame stack... enterCall() has already pushed this call's frame, which knows where it was called
+        protected : void executeFrame (const std::vector<std::shared_ptr<Stmt>>& statements, const ScopeLayout& layout,
+                                     std::vector<std::shared_ptr<Upvalue>>& closure, size_t frame) {
+            if (frame + layout.slotEnd > STACK_MAX) throw RuntimeError(*callStack[callDepth - 1].callSite, "Stack overflow.");
+
+            // the caller already put the receiver and arguments in the first slots of the frame
+            size_t previousBase = frameBase, previousTop = stackTop;
+            std::vector<std::shared_ptr<Upvalue>>* previousUpvalues = upvalues;
+            frameBase = frame;
+            stackTop = frameBase + layout.slotEnd;
+            if (stack.size() < stackTop) stack.resize(stackTop);
+            upvalues = &closure;
 
             try {
-                this->environment = environment;
                 for (const std::shared_ptr<Stmt>& statement : statements) { execute(statement); }
             } catch (...) {
-                this->environment = previous;
+                popFrame(previousBase, previousTop, previousUpvalues);
                 throw;
             }
 
-            this->environment = previous;
+            popFrame(previousBase, previousTop, previousUpvalues);
+        }
+
+        void popFrame (size_t previousBase, size_t previousTop, std::vector<std::shared_ptr<Upvalue>>* previousUpvalues) {
+            closeUpvalues(frameBase);
+            clearSlots(frameBase, stackTop);
+            frameBase = previousBase;
+            stackTop = previousTop;
+            upvalues = previousUpvalues;
         }
 
         // yet another visitor ... added in ch08
+        // updated for escape analysis... blocks only claim slots, and only a captured one has upvalues to close
         std::any visitBlockStmt (std::shared_ptr<Block> stmt) override {
-            executeBlock(stmt->statements, std::make_shared<Environment>(environment));
+            const ScopeLayout& layout = layouts.at(stmt);
+            size_t previousTop = stackTop;
+            stackTop = std::max(stackTop, frameBase + layout.slotEnd);
+            if (stack.size() < stackTop) stack.resize(stackTop);
+
+            try {
+                for (const std::shared_ptr<Stmt>& statement : stmt->statements) { execute(statement); }
+            } catch (...) {
+                exitScope(layout, previousTop);
+                throw;
+            }
+
+            exitScope(layout, previousTop);
             return {};
         }
 
+        void exitScope (const ScopeLayout& layout, size_t previousTop) {
+            if (layout.captured) closeUpvalues(frameBase + layout.slotStart);
+            clearSlots(frameBase + layout.slotStart, frameBase + layout.slotEnd);
+            stackTop = previousTop;
+        }
+
         // updated in ch13
         std::any visitCLASSStmt (std::shared_ptr<CLASS> stmt) override {
             // added in ch13
             std::any superclass = nullptr;
             if (stmt->superclass != nullptr) {
                 superclass = eval(stmt->superclass);
-                if (superclass.type() != typeid(std::shared_ptr<LoxClass>)) throw RuntimeError(stmt->superclass->name, "Superclass must be a class.");  
+                if (callableOf<LoxClass>(superclass, CallableKind::CLASS) == nullptr) throw RuntimeError(stmt->superclass->name, "Superclass must be a class.");  
             }
 
 
-            environment->define(stmt->name.lexeme, nullptr);
+            define(stmt, stmt->name.lexeme, nullptr);
             // auto klass = std::make_shared<LoxClass>(stmt->name.lexeme);
 
-            // added in ch13
+            // added in ch13... updated for upvalue closures, 'super' gets a slot the methods capture
+            size_t previousTop = stackTop;
+            const ScopeLayout* layout = nullptr;
             if (stmt->superclass != nullptr) {
-                environment = std::make_shared<Environment>(environment);
-                environment->define("super", superclass);
+                layout = &layouts.at(stmt);
+                stackTop = std::max(stackTop, frameBase + layout->slotEnd);
+                if (stack.size() < stackTop) stack.resize(stackTop);
+                stack[frameBase + layout->slotStart] = superclass;
             }
 
             std::map<std::string, std::shared_ptr<LoxFunction>> methods;
             for (std::shared_ptr<Function> method : stmt->methods) {
-                auto function = std::make_shared<LoxFunction>(method, environment, method->name.lexeme == "init");
+                auto function = std::make_shared<LoxFunction>(method, captureUpvalues(method), method->name.lexeme == "init");
                 methods[method->name.lexeme] = function;
             }
 
             // added in ch13
-            std::shared_ptr<LoxClass> superklass = nullptr;
-            if (superclass.type() == typeid(std::shared_ptr<LoxClass>)) superklass = std::any_cast<std::shared_ptr<LoxClass>>(superclass);
+            // std::shared_ptr<LoxClass> superklass = nullptr;
+            // if (superclass.type() == typeid(std::shared_ptr<LoxClass>)) superklass = std::any_cast<std::shared_ptr<LoxClass>>(superclass);
+            std::shared_ptr<LoxClass> superklass = callableOf<LoxClass>(superclass, CallableKind::CLASS);
 
             // auto klass = std::make_shared<LoxClass>(stmt->name.lexeme, methods); updated in ch13
             auto klass = std::make_shared<LoxClass>(stmt->name.lexeme, superklass, methods); // added in ch13
 
             // added in ch13
-            if (superklass != nullptr) environment = environment->enclosing; 
+            if (layout != nullptr) exitScope(*layout, previousTop);
 
-            environment->assign(stmt->name, std::move(klass));
+            define(stmt, stmt->name.lexeme, std::shared_ptr<LoxCallable>{std::move(klass)});
             return {};
         }
 
@@ -143,18 +373,136 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
             return {};
         }
 
+        // added for fused loops... one node for the whole for statement instead of the Block + WHILE + Block it used to
+        // desugar into. The initializer's slots belong to the FOR's own scope. The first run checks whether it's a
+        // counted loop, and those go through runCounted()
+        std::any visitFORStmt (std::shared_ptr<FOR> stmt) override {
+            const ScopeLayout& layout = layouts.at(stmt);
+            size_t previousTop = stackTop;
+            stackTop = std::max(stackTop, frameBase + layout.slotEnd);
+            if (stack.size() < stackTop) stack.resize(stackTop);
+
+            try {
+                if (stmt->initializer != nullptr) execute(stmt->initializer);
+                if (stmt->counted.state == LoopState::UNCHECKED) stmt->counted = countedLoop(*stmt);
+
+                if (stmt->counted.state == LoopState::COUNTED) runCounted(*stmt);
+                else {
+                    while (stmt->condition == nullptr || isTruther(eval(stmt->condition))) {
+                        execute(stmt->body);
+                        if (stmt->increment != nullptr) eval(stmt->increment);
+                    }
+                }
+            } catch (...) {
+                exitScope(layout, previousTop);
+                throw;
+            }
+
+            exitScope(layout, previousTop);
+            return {};
+        }
+
+        // the loop variable's slot is found once, before the loop starts, and while it holds a number the test and the
+        // step happen right there. Anything else in it (the body can assign it) goes through the nodes' generic paths
+        // for that iteration, so a bad operand gets the same error it would without the fusion
+        void runCounted (const FOR& stmt) {
+            const CountedLoop& loop = stmt.counted;
+            const Binary& test = static_cast<const Binary&>(*stmt.condition);
+            std::any& counter = stack[frameBase + loop.slot]; // the stack never reallocates, so this stays put
+
+            for (;;) {
+                const double* i = std::any_cast<double>(&counter);
+                if (i != nullptr && loop.constantLimit) {
+                    if (!compare(loop.test, *i, loop.limit)) break;
+                } else {
+                    std::any left = counter;
+                    std::any right = loop.constantLimit ? std::any{loop.limit} : eval(test.right);
+                    const double* a = std::any_cast<double>(&left);
+                    const double* b = std::any_cast<double>(&right);
+                    bool keepGoing = a && b ? compare(loop.test, *a, *b) : isTruther(binary(test.op, left, right));
+                    if (!keepGoing) break;
+                }
+
+                execute(stmt.body);
+
+                if (double* next = std::any_cast<double>(&counter)) *next += loop.step;
+                else eval(stmt.increment);
+            }
+        }
+
+        // a counted loop is `var i = ...; i < limit; i = i + n` (or -, or any of the other comparisons) where i is a
+        // local, the limit is anything and n is a number literal
+        CountedLoop countedLoop (const FOR& stmt) {
+            CountedLoop loop;
+            loop.state = LoopState::GENERIC;
+
+            auto declaration = slots.find(stmt.initializer);
+            auto test = dynamic_cast<const Binary*>(stmt.condition.get());
+            auto assign = dynamic_cast<const Assign*>(stmt.increment.get());
+            if (declaration == slots.end() || test == nullptr || assign == nullptr) return loop;
+
+            int slot = declaration->second;
+            auto assigned = locals.find(stmt.increment);
+            if (!readsSlot(test->left, slot) || assigned == locals.end() || assigned->second.slot != slot) return loop;
+
+            auto sum = dynamic_cast<const Binary*>(assign->value.get());
+            if (sum == nullptr || !readsSlot(sum->left, slot) || (sum->op.type != Plus && sum->op.type != Minus)) return loop;
+            auto amount = dynamic_cast<const Literal*>(sum->right.get());
+            const double* step = amount != nullptr ? std::any_cast<double>(&amount->value) : nullptr;
+            if (step == nullptr) return loop;
+
+            switch (test->op.type) {
+                case Less         : loop.test = BinaryState::NUMBER_LESS; break;
+                case LessEqual    : loop.test = BinaryState::NUMBER_LESS_EQUAL; break;
+                case Greater      : loop.test = BinaryState::NUMBER_GREATER; break;
+                case GreaterEqual : loop.test = BinaryState::NUMBER_GREATER_EQUAL; break;
+                case EqualEqual   : loop.test = BinaryState::NUMBER_EQUAL; break;
+                case BangEqual    : loop.test = BinaryState::NUMBER_NOT_EQUAL; break;
+                default           : return loop;
+            }
+
+            auto limit = dynamic_cast<const Literal*>(test->right.get());
+            if (limit != nullptr && limit->value.type() == typeid(double)) {
+                loop.constantLimit = true;
+                loop.limit = std::any_cast<double>(limit->value);
+            }
+
+            loop.state = LoopState::COUNTED;
+            loop.slot = slot;
+            loop.step = sum->op.type == Plus ? *step : -*step;
+            return loop;
+        }
+
+        bool readsSlot (const std::shared_ptr<Expr>& expr, int slot) {
+            if (dynamic_cast<const Variable*>(expr.get()) == nullptr) return false;
+            auto local = locals.find(expr);
+            return local != locals.end() && local->second.slot == slot;
+        }
+
+        static bool compare (BinaryState test, double a, double b) {
+            switch (test) {
+                case BinaryState::NUMBER_LESS          : return a < b;
+                case BinaryState::NUMBER_LESS_EQUAL    : return a <= b;
+                case BinaryState::NUMBER_GREATER       : return a > b;
+                case BinaryState::NUMBER_GREATER_EQUAL : return a >= b;
+                case BinaryState::NUMBER_EQUAL         : return a == b;
+                default                                : return a != b;
+            }
+        }
+
         // added in ch10
         std::any visitFunctionStmt (std::shared_ptr<Function> stmt) override {
             // auto function = std::make_shared<LoxFunction>(stmt);
-            auto function = std::make_shared<LoxFunction>(stmt, environment, false);
-            environment->define(stmt->name.lexeme, function);
+            auto function = std::make_shared<LoxFunction>(stmt, captureUpvalues(stmt), false);
+            define(stmt, stmt->name.lexeme, std::shared_ptr<LoxCallable>{std::move(function)});
             return {};
         }
 
         // added in ch09
         // look at the condition, if it's true, execute the then branch, else execute the else branch
         std::any visitIFStmt (std::shared_ptr<IF> stmt) override {
-            if (isTruther(eval(stmt->condition))) execute(stmt->thenBranch);
+            // if (isTruther(eval(stmt->condition))) execute(stmt->thenBranch);
+            if (stmt->test != nullptr ? test(*stmt->test) : isTruther(eval(stmt->condition))) execute(stmt->thenBranch);
             else if (stmt->elseBranch != nullptr) execute(stmt->elseBranch);
             return {};
         }
@@ -162,13 +510,29 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
         // ... added in ch08
         std::any visitPRINTStmt(std::shared_ptr<PRINT> stmt) override {
             std::any value = eval(stmt->expression);
-            std::cout << stringify(value) << "\n";
+            // std::cout << stringify(value) << "\n"; ... buffered now
+            // strings can go out straight from their buffer instead of through a copy
+            if (value.type() == typeid(std::shared_ptr<LoxString>)) output.writeLine(std::any_cast<const std::shared_ptr<LoxString>&>(value)->str());
+            else if (value.type() == typeid(double)) {
+                char buffer[NUMBER_MAX];
+                output.writeLine(formatNumber(std::any_cast<double>(value), buffer));
+            }
+            else output.writeLine(stringify(value));
             return {};
         }
 
         // added in ch10
         std::any visitRETURNStmt (std::shared_ptr<RETURN> stmt) override {
             std::any value = nullptr;
+            // added for tail calls... the call is set up here but made by the LoxFunction whose frame it takes over
+            if (tailCalls.count(stmt) != 0) {
+                auto call = std::static_pointer_cast<Call>(stmt->value);
+                std::any callee = eval(call->callee);
+                size_t frame = pushArguments(call->arguments, call->paren);
+                stackTop = frame; // the arguments sit above the top so popping this frame leaves them alone
+                throw LoxTailCall{std::move(callee), &call->paren, frame, call->arguments.size()};
+            }
+
             if (stmt->value != nullptr) value = eval(stmt->value);
 
             throw LoxReturn{value};
@@ -178,13 +542,15 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
         std::any visitVARStmt(std::shared_ptr<VAR> stmt) override {
             std::any value = nullptr;
             if (stmt->initializer != nullptr) value = eval(stmt->initializer);
-            environment->define(stmt->name.lexeme, std::move(value));
+            define(stmt, stmt->name.lexeme, std::move(value));
             return {};
         }
 
         // added in ch09
         std::any visitWHILEStmt(std::shared_ptr<WHILE> stmt) override {
-            while (isTruther(eval(stmt->condition))) execute(stmt->body);
+            // while (isTruther(eval(stmt->condition))) execute(stmt->body);
+            if (stmt->test != nullptr) { while (test(*stmt->test)) execute(stmt->body); }
+            else { while (isTruther(eval(stmt->condition))) execute(stmt->body); }
             return {};
         }
 
@@ -193,55 +559,163 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
             std::any value = eval(expr->value);
             // environment->assign(expr->name, value);
 
-            auto findMe = locals.find(expr);
-            if (findMe != locals.end()) {
-                int distance = findMe->second;
-                environment->assignAt(distance, expr->name, value);
-            }  
-
-            else globals->assign(expr->name, value);
+            // auto findMe = locals.find(expr);
+            // if (findMe != locals.end()) {
+            //     variable(findMe->second) = value;
+            // }  
+            // else globals->assign(expr->name, value);
+            // updated for self-specializing nodes... the node remembers where its variable is
+            std::any* target = access(expr->name, expr, expr->cache);
+            if (target == nullptr) globals->assign(expr->name, value); // throws, it isn't defined
+            else *target = value;
             return value;
         }
 
-        std::any visitBinaryExpr (std::shared_ptr<Binary> expr) {
-            std::any left  = eval(expr->left);
-            std::any right = eval(expr->right);
+        // updated for self-specializing nodes... the first run picks a specialization from the operand types it sees, and
+        // after that the node only pays for its own guard. A guard that fails deoptimizes the node to GENERIC
+        // updated for superinstructions... the first run also decides which operands can be read in place
+        std::any visitBinaryExpr (std::shared_ptr<Binary> expr) override {
+            std::any leftValue, rightValue;
+            const std::any& left = operand(expr->left, expr->operands.left, expr->operands.leftSlot, leftValue);
+            const std::any& right = operand(expr->right, expr->operands.right, expr->operands.rightSlot, rightValue);
+            return binary(*expr, left, right);
+        }
 
-            switch (expr->op.type) {
+        std::any binary (Binary& expr, const std::any& left, const std::any& right) {
+            const double* a = std::any_cast<double>(&left);
+            const double* b = std::any_cast<double>(&right);
+
+            switch (expr.state) {
+                case BinaryState::UNSPECIALIZED:
+                    expr.state = specialize(expr.op.type, left, right);
+                    expr.operands = classify(expr);
+                    return binary(expr.op, left, right);
+                case BinaryState::GENERIC: return binary(expr.op, left, right);
+                case BinaryState::NUMBER_ADD: if (a && b) return *a + *b; break;
+                case BinaryState::NUMBER_SUBTRACT: if (a && b) return *a - *b; break;
+                case BinaryState::NUMBER_MULTIPLY: if (a && b) return *a * *b; break;
+                case BinaryState::NUMBER_DIVIDE: if (a && b) return *a / *b; break;
+                case BinaryState::NUMBER_LESS: if (a && b) return *a < *b; break;
+                case BinaryState::NUMBER_LESS_EQUAL: if (a && b) return *a <= *b; break;
+                case BinaryState::NUMBER_GREATER: if (a && b) return *a > *b; break;
+                case BinaryState::NUMBER_GREATER_EQUAL: if (a && b) return *a >= *b; break;
+                case BinaryState::NUMBER_EQUAL: if (a && b) return *a == *b; break;
+                case BinaryState::NUMBER_NOT_EQUAL: if (a && b) return *a != *b; break;
+                case BinaryState::STRING_CONCAT: {
+                    auto x = std::any_cast<std::shared_ptr<LoxString>>(&left);
+                    auto y = std::any_cast<std::shared_ptr<LoxString>>(&right);
+                    if (x && y) return LoxString::concat(*x, *y);
+                    break;
+                }
+            }
+
+            expr.state = BinaryState::GENERIC; // the guard failed
+            return binary(expr.op, left, right);
+        }
+
+        // added for superinstructions... the load-local and load-constant halves of a Binary, fused into it
+        const std::any& operand (const std::shared_ptr<Expr>& node, OperandKind kind, int slot, std::any& value) {
+            switch (kind) {
+                case OperandKind::LOCAL: return stack[frameBase + slot];
+                case OperandKind::CONSTANT: return static_cast<const Literal&>(*node).value;
+                case OperandKind::NODE: break;
+            }
+            return value = eval(node);
+        }
+
+        BinaryOperands classify (const Binary& expr) {
+            BinaryOperands operands;
+            operands.right = operandKind(expr.right, operands.rightSlot);
+            if (operands.right != OperandKind::NODE) operands.left = operandKind(expr.left, operands.leftSlot);
+            return operands;
+        }
+
+        OperandKind operandKind (const std::shared_ptr<Expr>& node, int& slot) {
+            if (dynamic_cast<const Literal*>(node.get()) != nullptr) return OperandKind::CONSTANT;
+            if (dynamic_cast<const Variable*>(node.get()) == nullptr) return OperandKind::NODE;
+
+            auto local = locals.find(node);
+            if (local == locals.end() || local->second.slot < 0) return OperandKind::NODE;
+            slot = local->second.slot;
+            return OperandKind::LOCAL;
+        }
+
+        // added for superinstructions... an IF or WHILE on a comparison, fused by the Optimizer. Two numbers are compared
+        // right here and the result never gets boxed into a std::any
+        bool test (Binary& condition) {
+            std::any leftValue, rightValue;
+            const std::any& left = operand(condition.left, condition.operands.left, condition.operands.leftSlot, leftValue);
+            const std::any& right = operand(condition.right, condition.operands.right, condition.operands.rightSlot, rightValue);
+
+            const double* a = std::any_cast<double>(&left);
+            const double* b = std::any_cast<double>(&right);
+            if (a && b && condition.state >= BinaryState::NUMBER_LESS && condition.state <= BinaryState::NUMBER_NOT_EQUAL) {
+                return compare(condition.state, *a, *b);
+            }
+            return isTruther(binary(condition, left, right));
+        }
+
+        static BinaryState specialize (TokenType op, const std::any& left, const std::any& right) {
+            bool numbers = left.type() == typeid(double) && right.type() == typeid(double);
+            bool strings = left.type() == typeid(std::shared_ptr<LoxString>) && right.type() == typeid(std::shared_ptr<LoxString>);
+
+            if (numbers) {
+                switch (op) {
+                    case Plus         : return BinaryState::NUMBER_ADD;
+                    case Minus        : return BinaryState::NUMBER_SUBTRACT;
+                    case Star         : return BinaryState::NUMBER_MULTIPLY;
+                    case Slash        : return BinaryState::NUMBER_DIVIDE;
+                    case Less         : return BinaryState::NUMBER_LESS;
+                    case LessEqual    : return BinaryState::NUMBER_LESS_EQUAL;
+                    case Greater      : return BinaryState::NUMBER_GREATER;
+                    case GreaterEqual : return BinaryState::NUMBER_GREATER_EQUAL;
+                    case EqualEqual   : return BinaryState::NUMBER_EQUAL;
+                    case BangEqual    : return BinaryState::NUMBER_NOT_EQUAL;
+                    default           : break;
+                }
+            }
+            if (strings && op == Plus) return BinaryState::STRING_CONCAT;
+            return BinaryState::GENERIC;
+        }
+
+        // the unspecialized binary operator, on operands that are already evaluated
+        std::any binary (const Token& op, const std::any& left, const std::any& right) {
+            switch (op.type) {
                 case Greater      :
-                    checkNumberOperands(expr->op, left, right);
+                    checkNumberOperands(op, left, right);
                     return std::any_cast<double>(left) >  std::any_cast<double>(right);
                 case GreaterEqual :
-                    checkNumberOperands(expr->op, left, right);
+                    checkNumberOperands(op, left, right);
                     return std::any_cast<double>(left) >= std::any_cast<double>(right);
                 case Less         :
-                    checkNumberOperands(expr->op, left, right);
+                    checkNumberOperands(op, left, right);
                     return std::any_cast<double>(left) <  std::any_cast<double>(right);
                 case LessEqual    :
-                    checkNumberOperands(expr->op, left, right);
+                    checkNumberOperands(op, left, right);
                     return std::any_cast<double>(left) <= std::any_cast<double>(right);
                 case BangEqual    : return !isEqual(left, right);
                 case EqualEqual   : return isEqual (left, right);
                 case Minus        :
-                    checkNumberOperands(expr->op, left, right);;
+                    checkNumberOperands(op, left, right);;
                     return std::any_cast<double>(left) -  std::any_cast<double>(right);
                 case Slash        : 
-                    checkNumberOperands(expr->op, left, right);
+                    checkNumberOperands(op, left, right);
                     return std::any_cast<double>(left) /  std::any_cast<double>(right);
                 case Star         :
-                    checkNumberOperands(expr->op, left, right);
+                    checkNumberOperands(op, left, right);
                     return std::any_cast<double>(left) *  std::any_cast<double>(right);
                 case Plus         :  
                     if (left.type() == typeid(double) && right.type() == typeid(double)) { // both are numbers, addition
                         return std::any_cast<double>(left) + std::any_cast<double>(right);
                     }
 
-                    if (left.type() == typeid(std::string) && right.type() == typeid(std::string)) { // both are strings, concatenate
-                        return std::any_cast<std::string>(left) + std::any_cast<std::string>(right);
+                    if (left.type() == typeid(std::shared_ptr<LoxString>) && right.type() == typeid(std::shared_ptr<LoxString>)) { // both are strings, concatenate
+                        // return std::any_cast<std::string>(left) + std::any_cast<std::string>(right); ... now a rope node
+                        return LoxString::concat(std::any_cast<const std::shared_ptr<LoxString>&>(left), std::any_cast<const std::shared_ptr<LoxString>&>(right));
                     }
 
                     // break; 
-                    throw RuntimeError{expr->op, "Operands must be two numbers or two strings."};
+                    throw RuntimeError{op, "Operands must be two numbers or two strings."};
             }
 
             // unreachable
@@ -249,24 +723,111 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
         }
 
         // added in ch10
+        // updated for native functions... arguments are evaluated straight into the callee's frame, and the callee is
+        // found with one pointer any_cast per kind instead of copying it out of the std::any
         std::any visitCallExpr (std::shared_ptr<Call> expr) override {
             std::any callee = eval(expr->callee);
-            std::vector<std::any> arguments;
-            for (const std::shared_ptr<Expr>& argument : expr->arguments) arguments.push_back(eval(argument));
+            size_t frame = pushArguments(expr->arguments, expr->paren);
 
-            std::shared_ptr<LoxCallable> function;
+            try {
+                std::any result = callValue(callee, expr->paren, frame, expr->arguments.size());
+                popArguments(frame);
+                return result;
+            } catch (...) {
+                popArguments(frame);
+                throw;
+            }
+        }
 
-            if (callee.type() == typeid(std::shared_ptr<LoxFunction>)) function = std::any_cast<std::shared_ptr<LoxFunction>>(callee);
-            else if (callee.type() == typeid(std::shared_ptr<LoxClass>)) function = std::any_cast<std::shared_ptr<LoxClass>>(callee);
-            else throw RuntimeError{expr->paren, "Can only call functions and classes."};
+        // returns the new frame's base slot, with the arguments in the slots after it
+        size_t pushArguments (const std::vector<std::shared_ptr<Expr>>& arguments, const Token& paren) {
+            size_t frame = stackTop;
+            if (frame + 1 + arguments.size() > STACK_MAX) throw RuntimeError{paren, "Stack overflow."};
 
-            if (arguments.size() != function->arity()) {
-            throw RuntimeError{expr->paren, "Expected " +
-                std::to_string(function->arity()) + " arguments but got " +
-                std::to_string(arguments.size()) + "."};
+            stackTop = frame + 1; // slot 0 is the receiver's
+            if (stack.size() < stackTop + arguments.size()) stack.resize(stackTop + arguments.size());
+
+            try {
+                for (const std::shared_ptr<Expr>& argument : arguments) {
+                    std::any value = eval(argument);
+                    stack[stackTop++] = std::move(value);
+                }
+            } catch (...) {
+                popArguments(frame);
+                throw;
             }
 
-            return function->call(*this, std::move(arguments));
+            return frame;
+        }
+
+        std::any callValue (const std::any& callee, const Token& paren, size_t frame, size_t argumentCount) {
+            // updated for callable dispatch... one any_cast, then the kind says what it is
+            auto callable = std::any_cast<std::shared_ptr<LoxCallable>>(&callee);
+            if (callable == nullptr) throw RuntimeError{paren, "Can only call functions and classes."};
+            LoxCallable* function = callable->get();
+            if (function->kind == CallableKind::NATIVE) {
+                auto native = static_cast<LoxNative*>(function);
+                checkArity(paren, native->argumentCount, argumentCount);
+                return native->function(*this, stack.data() + frame + 1); // no virtual call for natives
+            }
+
+            checkArity(paren, function->arity(), argumentCount);
+            callingFrom(paren);
+            return function->call(*this, frame);
+        }
+
+        // added for the frame stack
+        void callingFrom (const Token& paren) {
+            if (callDepth >= maxCallDepth || nearStackEnd()) throw RuntimeError{paren, "Stack overflow."};
+            callSite = &paren;
+        }
+
+        // added for superinstructions... what obj.name would be, for an Invoke. A method comes back unbound, anything
+        // else (a field, or an initializer, which has to be bound to return its instance) lands in callee
+        std::shared_ptr<LoxFunction> lookUpInvoke (const Invoke& expr, const std::any& object, std::any& callee) {
+            auto instance = std::any_cast<std::shared_ptr<LoxInstance>>(&object);
+            if (instance == nullptr) throw RuntimeError(expr.name, "Only instances have properties.");
+
+            if (const std::any* field = (*instance)->field(expr.name.lexeme)) {
+                callee = *field;
+                return nullptr;
+            }
+
+            std::shared_ptr<LoxFunction> method = (*instance)->findMethod(expr.name.lexeme);
+            if (method == nullptr) throw RuntimeError(expr.name, "Undefined property '" + expr.name.lexeme + "'.");
+            if (!method->isInitializer) return method;
+
+            callee = std::shared_ptr<LoxCallable>{method->bind(*instance)};
+            return nullptr;
+        }
+
+        // the instance goes straight into slot 0, where bind() would have had the method put it
+        std::any callMethod (LoxFunction& method, const std::any& instance, const Token& paren, size_t frame, size_t argumentCount) {
+            checkArity(paren, method.arity(), argumentCount);
+            callingFrom(paren);
+            stack[frame] = instance;
+            return method.call(*this, frame);
+        }
+
+        void checkArity (const Token& paren, int arity, size_t argumentCount) {
+            if (argumentCount != arity) {
+            throw RuntimeError{paren, "Expected " +
+                std::to_string(arity) + " arguments but got " +
+                std::to_string(argumentCount) + "."};
+            }
+        }
+
+        // added for tail calls... slides a tail call's arguments down into the frame of the call it replaces, which
+        // has already been popped. The two can overlap when the new call has more arguments than the old frame had slots
+        void reuseFrame (size_t frame, const LoxTailCall& tail) {
+            for (size_t i = 1; i <= tail.argumentCount; i++) stack[frame + i] = std::move(stack[tail.frame + i]);
+            clearSlots(std::max(tail.frame, frame + 1 + tail.argumentCount), tail.frame + 1 + tail.argumentCount);
+            stackTop = frame + 1 + tail.argumentCount;
+        }
+
+        void popArguments (size_t frame) {
+            clearSlots(frame, stackTop);
+            stackTop = frame;
         }
 
         // added in ch12
@@ -279,6 +840,25 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
 
         std::any visitGroupingExpr (std::shared_ptr<Grouping> expr) override { return eval(expr->expression); } // grouping has a ref to an inner node
 
+        // added for superinstructions... obj.name(args) in one node, which the Optimizer makes out of a Call on a GET.
+        // A method is called without making a bound copy of it first
+        std::any visitInvokeExpr (std::shared_ptr<Invoke> expr) override {
+            std::any object = eval(expr->object);
+            std::any callee;
+            std::shared_ptr<LoxFunction> method = lookUpInvoke(*expr, object, callee);
+            size_t frame = pushArguments(expr->arguments, expr->paren);
+
+            try {
+                std::any result = method != nullptr ? callMethod(*method, object, expr->paren, frame, expr->arguments.size())
+                                                    : callValue(callee, expr->paren, frame, expr->arguments.size());
+                popArguments(frame);
+                return result;
+            } catch (...) {
+                popArguments(frame);
+                throw;
+            }
+        }
+
         std::any visitLiteralExpr (std::shared_ptr<Literal> expr) override { return expr->value; } // literal tree node -> runtime val
 
         // added ch09
@@ -302,18 +882,18 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
 
         // added in ch13
         std::any visitSUPERExpr (std::shared_ptr<SUPER> expr) override {
-            int distance = locals[expr];
-            auto superclass = std::any_cast<std::shared_ptr<LoxClass>>(environment->getAt(distance, "super"));
-            auto object = std::any_cast<std::shared_ptr<LoxInstance>>(environment->getAt(distance - 1, "this"));
+            // int distance = locals[expr];
+            auto superclass = callableOf<LoxClass>(variable(locals.at(expr)), CallableKind::CLASS);
+            auto object = std::any_cast<std::shared_ptr<LoxInstance>>(variable(receivers.at(expr)));
 
             std::shared_ptr<LoxFunction> method = superclass->findMethod(expr->method.lexeme);
             if (method == nullptr) throw RuntimeError(expr->method, "Undefined property '" + expr->method.lexeme + "'.");
 
-            return method->bind(object);
+            return std::shared_ptr<LoxCallable>{method->bind(object)};
         }
 
         // added in ch12
-        std::any visitTHISExpr (std::shared_ptr<THIS> expr) override { return lookUpVariable(expr->keyword, expr); }
+        std::any visitTHISExpr (std::shared_ptr<THIS> expr) override { return lookUpVariable(expr->keyword, expr, expr->cache); }
 
         std::any visitUnaryExpr (std::shared_ptr<Unary> expr) override {
             std::any right = eval(expr->right);
@@ -331,18 +911,95 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
         }
 
         // updated in ch11
-        std::any visitVariableExpr (std::shared_ptr<Variable> expr) override { return lookUpVariable(expr->name, expr); }
+        std::any visitVariableExpr (std::shared_ptr<Variable> expr) override { return lookUpVariable(expr->name, expr, expr->cache); }
 
     private:
         // std::shared_ptr<Environment> environment{new Environment}; // added in ch08 .. I moved this to the top of class
 
-        std::any lookUpVariable(const Token& name, std::shared_ptr<Expr> expr) {
+        // std::any lookUpVariable(const Token& name, std::shared_ptr<Expr> expr) {
+        //     auto local = locals.find(expr);
+        //     if (local != locals.end()) {
+        //         return variable(local->second);
+        //     }
+        //     else return globals->get(name);
+        // }
+        std::any lookUpVariable (const Token& name, const std::shared_ptr<Expr>& expr, VariableCache& cache) {
+            std::any* value = access(name, expr, cache);
+            if (value == nullptr) return globals->get(name); // throws, it isn't defined
+            return *value;
+        }
+
+        // added for self-specializing nodes... the first run looks the expression up in the Resolver's table and
+        // rewrites the node's cache to say where the variable is, every run after that goes straight there.
+        // Returns null for a global that isn't defined (yet), which isn't cached so it's looked for again next time
+        std::any* access (const Token& name, const std::shared_ptr<Expr>& expr, VariableCache& cache) {
+            switch (cache.state) {
+                case AccessState::LOCAL: return &stack[frameBase + cache.index];
+                case AccessState::UPVALUE: return (*upvalues)[cache.index]->location;
+                case AccessState::GLOBAL: return cache.global;
+                case AccessState::UNRESOLVED: break;
+            }
+
             auto local = locals.find(expr);
             if (local != locals.end()) {
-                int distance = local->second;
-                return environment->getAt(distance, name.lexeme);
+                if (local->second.slot >= 0) cache = VariableCache{AccessState::LOCAL, local->second.slot};
+                else cache = VariableCache{AccessState::UPVALUE, local->second.upvalue};
+                return &variable(local->second);
+            }
+
+            std::any* global = globals->find(name.lexeme);
+            if (global != nullptr) cache = VariableCache{AccessState::GLOBAL, 0, global};
+            return global;
+        }
+
+        // added for escape analysis... a local's value is either in our frame or behind one of our upvalues
+        std::any& variable (const Local& local) {
+            if (local.slot >= 0) return stack[frameBase + local.slot];
+            return *(*upvalues)[local.upvalue]->location;
+        }
+
+        // globals go to the Environment, everything else to its slot
+        void define (std::shared_ptr<Stmt> declaration, const std::string& name, std::any value) {
+            auto slot = slots.find(declaration);
+            if (slot != slots.end()) stack[frameBase + slot->second] = std::move(value);
+            else globals->define(name, std::move(value));
+        }
+
+        // added for upvalue closures... hands a new closure the locals and upvalues the resolver said it captures
+        std::vector<std::shared_ptr<Upvalue>> captureUpvalues (const std::shared_ptr<Function>& function) {
+            std::vector<std::shared_ptr<Upvalue>> closure;
+            for (const Capture& capture : captures.at(function)) {
+                if (capture.isLocal) closure.push_back(captureUpvalue(stack.data() + frameBase + capture.index));
+                else closure.push_back((*upvalues)[capture.index]);
+            }
+
+            return closure;
+        }
+
+        // closures that capture the same local have to share one upvalue
+        std::shared_ptr<Upvalue> captureUpvalue (std::any* local) {
+            auto open = openUpvalues.end();
+            while (open != openUpvalues.begin() && (*(open - 1))->location >= local) {
+                --open;
+                if ((*open)->location == local) return *open;
+            }
+
+            return *openUpvalues.insert(open, std::make_shared<Upvalue>(local));
+        }
+
+        // moves every open upvalue at or above slot off the stack
+        void closeUpvalues (size_t slot) {
+            while (!openUpvalues.empty() && openUpvalues.back()->location >= stack.data() + slot) {
+                Upvalue& upvalue = *openUpvalues.back();
+                upvalue.closed = std::move(*upvalue.location);
+                upvalue.location = &upvalue.closed;
+                openUpvalues.pop_back();
             }
-            else return globals->get(name);
+        }
+
+        // drop whatever the slots were holding so dead locals don't keep objects alive
+        void clearSlots (size_t start, size_t end) {
+            for (size_t i = start; i < end; ++i) stack[i].reset();
         }
 
         void checkNumberOperand (const Token& op, const std::any& operand) {
@@ -367,29 +1024,50 @@ class Interpreter: public ExprVisitor, public StmtVisitor {
             if (a.type() == typeid(nullptr) && b.type() == typeid(nullptr)) return true;
             if (a.type() == typeid(nullptr)) return false;
 
-            if (a.type() == typeid(std::string) && b.type() == typeid(std::string)) return std::any_cast<std::string>(a) == std::any_cast<std::string>(b);
+            if (a.type() == typeid(std::shared_ptr<LoxString>) && b.type() == typeid(std::shared_ptr<LoxString>)) {
+                return *std::any_cast<const std::shared_ptr<LoxString>&>(a) == *std::any_cast<const std::shared_ptr<LoxString>&>(b);
+            }
             if (a.type() == typeid(double) && b.type() == typeid(double)) return std::any_cast<double>(a) == std::any_cast<double>(b); 
             if (a.type() == typeid(bool) && b.type() == typeid(bool)) return std::any_cast<bool>(a) == std::any_cast<bool>(b);
 
             return false;
         }
 
+        // added for fast number printing... the shortest text that reads back as the same double (so 0.1 prints 0.1),
+        // with integral values going through the much cheaper integer conversion. Names match jlox for NaN and infinity
+        static constexpr int NUMBER_MAX = 32;
+
+        static std::string_view formatNumber (double number, char (&buffer)[NUMBER_MAX]) {
+            if (std::isnan(number)) return "NaN";
+            if (std::isinf(number)) return number > 0 ? "Infinity" : "-Infinity";
+
+            std::to_chars_result result;
+            if (number == 0 && std::signbit(number)) return "-0";
+            if (std::fabs(number) < 9007199254740992.0 && number == std::trunc(number)) { // 2^53, every integer up to it is exact
+                result = std::to_chars(buffer, buffer + NUMBER_MAX, static_cast<long long>(number));
+            }
+            else result = std::to_chars(buffer, buffer + NUMBER_MAX, number);
+
+            return std::string_view(buffer, result.ptr - buffer);
+        }
+
         std::string stringify (const std::any& obj) {
             if (obj.type() == typeid(nullptr)) return "nil";
 
             if (obj.type() == typeid(double)) {
-                std::string text = std::to_string(std::any_cast<double>(obj));
-                if (text[text.length() - 2] == '.' && text[text.length() - 1] == '0') { text = text.substr(0, text.length() - 2); }
-                return text;
+                // std::string text = std::to_string(std::any_cast<double>(obj));
+                // if (text[text.length() - 2] == '.' && text[text.length() - 1] == '0') { text = text.substr(0, text.length() - 2); }
+                // return text;
+                char buffer[NUMBER_MAX];
+                return std::string{formatNumber(std::any_cast<double>(obj), buffer)};
             }
 
-            if (obj.type() == typeid(std::string)) return std::any_cast<std::string>(obj);
+            if (obj.type() == typeid(std::shared_ptr<LoxString>)) return std::any_cast<const std::shared_ptr<LoxString>&>(obj)->str();
             
             if (obj.type() == typeid(bool)) return std::any_cast<bool>(obj) ? "true" : "false";
             
-            if (obj.type() == typeid(std::shared_ptr<LoxFunction>)) return std::any_cast< std::shared_ptr<LoxFunction>>(obj)->toString();
-            
-            if (obj.type() == typeid(std::shared_ptr<LoxClass>)) return std::any_cast<std::shared_ptr<LoxClass>>(obj)->toString();
+            // functions, natives and classes... updated for callable dispatch
+            if (obj.type() == typeid(std::shared_ptr<LoxCallable>)) return std::any_cast<const std::shared_ptr<LoxCallable>&>(obj)->toString();
             
             if (obj.type() == typeid(std::shared_ptr<LoxInstance>)) return std::any_cast<std::shared_ptr<LoxInstance>>(obj)->toString();
 
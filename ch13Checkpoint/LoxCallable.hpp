@@ -1,15 +1,35 @@
 #pragma once
 
 #include <any>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 class Interpreter;
 
+// added for callable dispatch... every callable value is held as a shared_ptr<LoxCallable>, so a call takes one
+// any_cast and then a switch on this instead of trying each type in turn
+enum class CallableKind : std::uint8_t { FUNCTION, CLASS, NATIVE };
+
 class LoxCallable {
 public:
+  const CallableKind kind;
+  explicit LoxCallable (CallableKind kind) : kind{kind} {}
   virtual int arity() = 0;
-  virtual std::any call(Interpreter& interpreter,  std::vector<std::any> arguments) = 0;
+  // virtual std::any call(Interpreter& interpreter,  std::vector<std::any> arguments) = 0;
+  // updated for native functions... the arguments are already sitting in the interpreter's stack at slots 1..arity()
+  // of the callee's frame (slot 0 is saved for a method's receiver), so nothing gets copied
+  virtual std::any call(Interpreter& interpreter, size_t frame) = 0;
   virtual std::string toString() = 0;
   virtual ~LoxCallable() = default;
-};
\ No newline at end of file
+};
+
+// the callable a value holds if it's one of that kind, otherwise null
+template <typename Callable>
+std::shared_ptr<Callable> callableOf (const std::any& value, CallableKind kind) {
+  auto callable = std::any_cast<std::shared_ptr<LoxCallable>>(&value);
+  if (callable == nullptr || (*callable)->kind != kind) return nullptr;
+  return std::static_pointer_cast<Callable>(*callable);
+}
\ No newline at end of file
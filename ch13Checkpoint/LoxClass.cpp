@@ -8,7 +8,7 @@
 //  : name{std::move(name)}, methods{std::move(methods)} {} // updated in ch13
 
 LoxClass::LoxClass(std::string name, std::shared_ptr<LoxClass> superclass, std::map<std::string, std::shared_ptr<LoxFunction>> methods)
-  : superclass{superclass}, name{std::move(name)}, methods{std::move(methods)} {} // added in ch13
+  : LoxCallable{CallableKind::CLASS}, superclass{superclass}, name{std::move(name)}, methods{std::move(methods)} {} // added in ch13
 
 // updated in ch13
 std::shared_ptr<LoxFunction> LoxClass::findMethod (const std::string& name) {
@@ -20,10 +20,10 @@ std::shared_ptr<LoxFunction> LoxClass::findMethod (const std::string& name) {
 
 std::string LoxClass::toString() { return name; }
 
-std::any LoxClass::call(Interpreter& interpreter, std::vector<std::any> arguments) {
+std::any LoxClass::call(Interpreter& interpreter, size_t frame) {
   auto instance = std::make_shared<LoxInstance>(shared_from_this());
   std::shared_ptr<LoxFunction> initializer = findMethod("init");
-  if (initializer != nullptr) initializer->bind(instance)->call(interpreter, std::move(arguments));
+  if (initializer != nullptr) initializer->bind(instance)->call(interpreter, frame);
 
   return instance;
 }
@@ -7,6 +7,7 @@
 #include <vector>
 // #include <unordered_map>
 
+#include "Allocations.hpp"
 #include "Interpreter.hpp"
 #include "LoxCallable.hpp"
 #include "LoxFunction.hpp"
@@ -18,12 +19,13 @@ class Interpreter;
 class LoxFunction;
 
 // class LoxClass : public std::enable_shared_from_this<LoxClass> {
-class LoxClass : public LoxCallable, public std::enable_shared_from_this<LoxClass> {
+class LoxClass : public LoxCallable, public std::enable_shared_from_this<LoxClass>, Counted<LoxClass, AllocationKind::CLASS> {
     private: 
         std::string name;
         std::map<std::string, std::shared_ptr<LoxFunction>> methods;
         const std::shared_ptr<LoxClass> superclass; // added in ch13    
         friend class LoxInstance;
+        friend class HeapSnapshot; // added for snapshots
 
     public:
         // LoxClass (std::string name);
@@ -32,7 +34,7 @@ class LoxClass : public LoxCallable, public std::enable_shared_from_this<LoxClas
 
         std::string toString();
 
-        std::any call (Interpreter& interpreter, std::vector<std::any> arguments) override;
+        std::any call (Interpreter& interpreter, size_t frame) override;
 
         int arity() override;
 
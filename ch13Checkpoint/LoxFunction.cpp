@@ -1,4 +1,3 @@
-#include "Environment.hpp"
 #include "LoxFunction.hpp"
 #include "Interpreter.hpp"
 #include "Stmt.hpp"
@@ -7,32 +6,58 @@
 
 // LoxFunction::LoxFunction (std::shared_ptr<Function> declaration) : declaration{std::move(declaration)} {}
 
-LoxFunction::LoxFunction(std::shared_ptr<Function> declaration, std::shared_ptr<Environment> closure, bool isInitializer)
-  : isInitializer{isInitializer}, closure{std::move(closure)}, declaration{std::move(declaration)} {}
+LoxFunction::LoxFunction(std::shared_ptr<Function> declaration, std::vector<std::shared_ptr<Upvalue>> upvalues, bool isInitializer)
+  : LoxCallable{CallableKind::FUNCTION}, isInitializer{isInitializer}, upvalues{std::move(upvalues)}, declaration{std::move(declaration)} {}
 
 std::shared_ptr<LoxFunction> LoxFunction::bind( std::shared_ptr<LoxInstance> instance) {
-    auto environment = std::make_shared<Environment>(closure);
-    environment->define("this", instance);
+    // auto environment = std::make_shared<Environment>(closure);
+    // environment->define("this", instance);
     // return std::make_shared<LoxFunction>(declaration, environment);
-    return std::make_shared<LoxFunction>(declaration, environment, isInitializer);
+    auto method = std::make_shared<LoxFunction>(declaration, upvalues, isInitializer);
+    method->receiver = std::move(instance); // updated for upvalue closures
+    return method;
 }
 
 std::string LoxFunction::toString() { return "<fn " + declaration->name.lexeme + ">"; }
 
 int LoxFunction::arity() { return declaration->params.size(); }
 
-std::any LoxFunction::call (Interpreter& interpreter, std::vector<std::any> arguments) {
-    // auto environment = std::make_shared<Environment>(interpreter.globals);
-    auto environment = std::make_shared<Environment>(closure);
-    for (int i = 0; i < declaration->params.size(); ++i) { environment->define(declaration->params[i].lexeme, arguments[i]); }
-    // interpreter.executeBlock(declaration->body, environment);
-    try {
-        interpreter.executeBlock(declaration->body, environment);
-    } catch (LoxReturn returnValue) {
-        if (isInitializer) return closure->getAt(0, "this");
-        return returnValue.value;
+// updated for tail calls... a tail call in the body comes back here as a LoxTailCall once the body's frame is popped,
+// and the callee runs in that same frame. Only a LoxFunction keeps the loop going, a class or native is just called
+std::any LoxFunction::call (Interpreter& interpreter, size_t frame) {
+    std::shared_ptr<LoxFunction> callee; // keeps the function we're running alive once the caller's value is gone
+    LoxFunction* function = this;
+    for (;;) {
+        // auto environment = std::make_shared<Environment>(interpreter.globals);
+        // updated for upvalue closures... no Environment at all, the body runs in a frame of stack slots
+        const Interpreter::ScopeLayout& layout = interpreter.layouts.at(function->declaration);
+        if (function->receiver != nullptr) interpreter.stack[frame] = function->receiver;
+        // interpreter.executeBlock(declaration->body, environment);
+        interpreter.enterCall(function->declaration.get()); // for the sampling profiler
+        try {
+            interpreter.executeFrame(function->declaration->body, layout, function->upvalues, frame);
+        } catch (LoxReturn returnValue) {
+            interpreter.leaveCall();
+            if (function->isInitializer) return function->receiver;
+            return returnValue.value;
+        } catch (LoxTailCall& tail) {
+            interpreter.leaveCall();
+            interpreter.reuseFrame(frame, tail);
+            interpreter.tailCall(tail.callee);
+            callee = callableOf<LoxFunction>(tail.callee, CallableKind::FUNCTION);
+            if (callee == nullptr) return interpreter.callValue(tail.callee, *tail.paren, frame, tail.argumentCount);
+
+            interpreter.checkArity(*tail.paren, callee->arity(), tail.argumentCount);
+            interpreter.callSite = tail.paren;
+            function = callee.get();
+            continue;
+        } catch (...) {
+            interpreter.leaveCall();
+            throw;
+        }
+
+        interpreter.leaveCall();
+        if (function->isInitializer) return function->receiver;
+        return nullptr;
     }
-
-    if (isInitializer) return closure->getAt(0, "this");
-    return nullptr;
 }
\ No newline at end of file
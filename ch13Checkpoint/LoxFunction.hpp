@@ -1,25 +1,32 @@
 #pragma once
 
+#include "Allocations.hpp"
 #include "LoxCallable.hpp"
 #include "LoxInstance.hpp"
+#include "Upvalue.hpp"
 
 #include <any>
 #include <memory>
 #include <string>
 #include <vector>
 
-class Environment;
 class Function;
 class LoxInstance;
 
-class LoxFunction: public LoxCallable, public std::enable_shared_from_this<LoxFunction> {
+class LoxFunction: public LoxCallable, public std::enable_shared_from_this<LoxFunction>,
+                   Counted<LoxFunction, AllocationKind::FUNCTION> {
   std::shared_ptr<Function> declaration;
-  std::shared_ptr<Environment> closure;
+  // std::shared_ptr<Environment> closure; ... replaced by upvalues, so we only keep alive what the body uses
+  std::vector<std::shared_ptr<Upvalue>> upvalues;
+  std::shared_ptr<LoxInstance> receiver; // set by bind(), lands in slot 0 of the method's frame
   bool isInitializer;
+  friend class ProfilingInterpreter; // reads the declaration for its report
+  friend class Interpreter; // added for superinstructions, an Invoke needs to know if it's calling an initializer
+  friend class HeapSnapshot; // added for snapshots, writes all of it out and rebuilds it
 
 public:
   // LoxFunction(std::shared_ptr<Function> declaration);
-  LoxFunction (std::shared_ptr<Function> declaration, std::shared_ptr<Environment> closure, bool isInitializer);
+  LoxFunction (std::shared_ptr<Function> declaration, std::vector<std::shared_ptr<Upvalue>> upvalues, bool isInitializer);
 
   std::shared_ptr<LoxFunction> bind (std::shared_ptr<LoxInstance> instance);
 
@@ -27,5 +34,5 @@ public:
 
   int arity() override;
 
-  std::any call(Interpreter& interpreter, std::vector<std::any> arguments) override;
+  std::any call(Interpreter& interpreter, size_t frame) override;
 };
\ No newline at end of file
@@ -11,11 +11,18 @@ std::any LoxInstance::get(const Token& name) {
 
     std::shared_ptr<LoxFunction> method = klass->findMethod(name.lexeme);
     // if (method != nullptr) return method;
-    if (method != nullptr) return method->bind(shared_from_this());
+    if (method != nullptr) return std::shared_ptr<LoxCallable>{method->bind(shared_from_this())};
 
     throw RuntimeError(name, "Undefined property '" + name.lexeme + "'.");
 }
 
+const std::any* LoxInstance::field (const std::string& name) {
+    auto field = fields.find(name);
+    return field != fields.end() ? &field->second : nullptr;
+}
+
+std::shared_ptr<LoxFunction> LoxInstance::findMethod (const std::string& name) { return klass->findMethod(name); }
+
 void LoxInstance::set (const Token& name, std::any value) { fields[name.lexeme] = std::move(value); }
 
 std::string LoxInstance::toString() { return klass->name + " instance"; }
\ No newline at end of file
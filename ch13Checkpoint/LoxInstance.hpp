@@ -6,19 +6,27 @@
 #include <string>
 // #include <unordered_map>    
 
+#include "Allocations.hpp"
+
 class LoxClass;
+class LoxFunction;
 class Token;
 
-class LoxInstance: public std::enable_shared_from_this<LoxInstance> {
+class LoxInstance: public std::enable_shared_from_this<LoxInstance>, Counted<LoxInstance, AllocationKind::INSTANCE> {
     private: 
         std::shared_ptr<LoxClass> klass;
         std::map<std::string, std::any> fields;
+        friend class HeapSnapshot; // added for snapshots
 
     public: 
         LoxInstance (std::shared_ptr<LoxClass> klass);
 
         std::any get (const Token& name);
 
+        // added for superinstructions... the two halves of get(), so an Invoke can call a method without binding it
+        const std::any* field (const std::string& name);
+        std::shared_ptr<LoxFunction> findMethod (const std::string& name);
+
         void set (const Token& name, std::any value);
 
         std::string toString();
@@ -0,0 +1,6 @@
+#include "LoxNative.hpp"
+#include "Interpreter.hpp"
+
+// natives don't normally come through here (visitCallExpr calls the function pointer directly), but this keeps
+// LoxNative a LoxCallable like everything else
+std::any LoxNative::call (Interpreter& interpreter, size_t frame) { return function(interpreter, interpreter.stack.data() + frame + 1); }
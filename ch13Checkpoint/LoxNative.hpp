@@ -0,0 +1,30 @@
+#pragma once
+
+#include <any>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LoxCallable.hpp"
+
+class Interpreter;
+
+// added for native functions... a host function gets its arguments as a pointer into the interpreter's stack,
+// so calling one never builds a vector
+using NativeFunction = std::any (*)(Interpreter& interpreter, const std::any* arguments);
+
+class LoxNative: public LoxCallable {
+    public:
+        const std::string name;
+        const int argumentCount;
+        const NativeFunction function;
+
+        LoxNative (std::string name, int argumentCount, NativeFunction function)
+            : LoxCallable{CallableKind::NATIVE}, name{std::move(name)}, argumentCount{argumentCount}, function{function} {}
+
+        int arity() override { return argumentCount; }
+
+        std::any call (Interpreter& interpreter, size_t frame) override;
+
+        std::string toString() override { return "<native fn>"; }
+};
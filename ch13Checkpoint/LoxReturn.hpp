@@ -1,7 +1,20 @@
 #pragma once
 
 #include <any>
+#include <cstddef>
+
+#include "Token.hpp"
 
 struct LoxReturn {
   std::any value;
+};
+
+// added for tail calls... thrown by a return whose value is a call, after the callee and arguments are evaluated. The
+// arguments are sitting in a frame of their own at the top of the stack, the LoxFunction that catches it moves them
+// into its own frame and makes the call from there
+struct LoxTailCall {
+  std::any callee;
+  const Token* paren;
+  size_t frame;
+  size_t argumentCount;
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Allocations.hpp"
+
+// added for rope strings... the runtime value of every Lox string. It's immutable, so values share it through a
+// shared_ptr instead of copying characters around. Concatenating just makes a node pointing at both halves, and the
+// characters only get laid out in one buffer (flattened) the first time someone needs to look at them, so building
+// a string with s = s + x in a loop is linear instead of quadratic. Copying a string value anywhere (variables,
+// arguments, fields) is only ever a pointer copy
+class LoxString: Counted<LoxString, AllocationKind::STRING> {
+    private:
+        // concatenations shorter than this are cheaper to copy right away than to keep as a node
+        static constexpr size_t FLAT_MAX = 64;
+
+        mutable std::string flat;
+        mutable std::shared_ptr<const LoxString> left, right; // both null once flattened
+        size_t length;
+        mutable size_t hashCode = 0;
+        mutable bool hashed = false;
+
+    public:
+        LoxString (std::string text) : flat{std::move(text)}, length{flat.size()} { countCharacters(heapBytes(flat)); }
+
+        LoxString (std::shared_ptr<const LoxString> left, std::shared_ptr<const LoxString> right)
+            : left{std::move(left)}, right{std::move(right)}, length{this->left->length + this->right->length} {}
+
+        // a rope built in a loop is one long chain of nodes, so tear it down without recursing through every one
+        ~LoxString () {
+            countCharacters(-static_cast<long long>(heapBytes(flat)));
+
+            std::vector<std::shared_ptr<const LoxString>> children;
+            if (left != nullptr) children.push_back(std::move(left));
+            if (right != nullptr) children.push_back(std::move(right));
+
+            while (!children.empty()) {
+                std::shared_ptr<const LoxString> child = std::move(children.back());
+                children.pop_back();
+                if (child.use_count() != 1) continue; // someone else still holds it, so it won't die here
+
+                if (child->left != nullptr) children.push_back(std::move(child->left));
+                if (child->right != nullptr) children.push_back(std::move(child->right));
+            }
+        }
+
+        static std::shared_ptr<LoxString> concat (const std::shared_ptr<LoxString>& a, const std::shared_ptr<LoxString>& b) {
+            if (a->length == 0) return b;
+            if (b->length == 0) return a;
+            if (a->length + b->length <= FLAT_MAX) return std::make_shared<LoxString>(a->str() + b->str());
+            return std::make_shared<LoxString>(a, b);
+        }
+
+        size_t size () const { return length; }
+
+        // cached, since the characters never change... added for shared strings
+        size_t hash () const {
+            if (!hashed) {
+                hashCode = std::hash<std::string>{}(str());
+                hashed = true;
+            }
+
+            return hashCode;
+        }
+
+        // flattens on first use... walks the rope with an explicit stack since it can be as deep as it is long
+        const std::string& str () const {
+            if (left == nullptr) return flat;
+
+            size_t before = heapBytes(flat);
+            flat.reserve(length);
+            std::vector<const LoxString*> pending{right.get(), left.get()};
+            while (!pending.empty()) {
+                const LoxString* node = pending.back();
+                pending.pop_back();
+
+                if (node->left == nullptr) flat += node->flat;
+                else {
+                    pending.push_back(node->right.get());
+                    pending.push_back(node->left.get());
+                }
+            }
+
+            left = nullptr;
+            right = nullptr;
+            countCharacters(static_cast<long long>(heapBytes(flat)) - static_cast<long long>(before));
+            return flat;
+        }
+
+        // the same object, a different length or a different cached hash all answer without touching the characters
+        bool operator== (const LoxString& other) const {
+            if (this == &other) return true;
+            if (length != other.length) return false;
+            if (hashed && other.hashed && hashCode != other.hashCode) return false;
+            return hash() == other.hash() && str() == other.str();
+        }
+
+    private:
+        static void countCharacters (long long bytes) { allocations.addBytes(AllocationKind::STRING, bytes); }
+
+        // a short string's characters sit in the std::string itself, which sizeof(LoxString) already counted. Only a
+        // capacity past that buffer means a separate allocation
+        static inline const size_t SSO_CAPACITY = std::string{}.capacity();
+        static size_t heapBytes (const std::string& text) { return text.capacity() > SSO_CAPACITY ? text.capacity() + 1 : 0; }
+};
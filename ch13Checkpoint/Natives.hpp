@@ -0,0 +1,47 @@
+#pragma once
+
+#include <any>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <time.h>
+
+#include "Allocations.hpp"
+#include "LoxString.hpp"
+
+class Interpreter;
+
+// the built-in native functions... Interpreter() registers each of these with defineNative()
+
+// updated for timing natives... every clock counts from when the program started, so even nanosecond readings stay
+// well inside the 2^53 range where a double holds integers exactly
+inline const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+// native clock added in ch10... monotonic seconds now (it used to be system_clock seconds divided by 1000)
+inline std::any clockNative (Interpreter&, const std::any*) {
+    return std::chrono::duration<double>{std::chrono::steady_clock::now() - startTime}.count();
+}
+
+// monotonic nanoseconds, for timing short stretches of code
+inline std::any nanoClockNative (Interpreter&, const std::any*) {
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - startTime).count());
+}
+
+// seconds of CPU time used by this process, which leaves out time spent waiting or descheduled
+inline std::any cpuClockNative (Interpreter&, const std::any*) {
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+}
+
+// added for allocation accounting... the same table --stats prints, as a string
+inline std::any heapStatsNative (Interpreter&, const std::any*) {
+    std::ostringstream report;
+    allocations.report(report);
+    return std::make_shared<LoxString>(report.str());
+}
+
+inline std::any liveBytesNative (Interpreter&, const std::any*) {
+    return static_cast<double>(allocations.liveBytes());
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+
+// added for self-specializing nodes... the state some Expr nodes carry so the Interpreter can rewrite how it runs
+// them after seeing them run once. GenerateAST puts these in the nodes as their only non-const members.
+
+// what a Binary has settled into. A specialized one checks its operands' types first (the guard) and falls back to
+// GENERIC for good when the guard fails, so a node that sees mixed types doesn't keep flipping back and forth
+enum class BinaryState : std::uint8_t {
+    UNSPECIALIZED,
+    GENERIC,
+    NUMBER_ADD,
+    NUMBER_SUBTRACT,
+    NUMBER_MULTIPLY,
+    NUMBER_DIVIDE,
+    NUMBER_LESS,
+    NUMBER_LESS_EQUAL,
+    NUMBER_GREATER,
+    NUMBER_GREATER_EQUAL,
+    NUMBER_EQUAL,
+    NUMBER_NOT_EQUAL,
+    STRING_CONCAT
+};
+
+// added for superinstructions... where a Binary gets each operand from. A local in a slot of the current frame or a
+// literal is read right where it is, anything else is evaluated. The left one is only read in place when the right
+// one can't run any code, since the right one could assign it
+enum class OperandKind : std::uint8_t { NODE, LOCAL, CONSTANT };
+
+struct BinaryOperands {
+    OperandKind left = OperandKind::NODE;
+    OperandKind right = OperandKind::NODE;
+    int leftSlot = 0;
+    int rightSlot = 0;
+};
+
+// where a variable expression found its variable the first time it ran, so it skips the Resolver's side table after
+// that. Where a local lives never changes, and a global's value never moves once it's defined
+enum class AccessState : std::uint8_t { UNRESOLVED, LOCAL, UPVALUE, GLOBAL };
+
+struct VariableCache {
+    AccessState state = AccessState::UNRESOLVED;
+    int index = 0;              // slot for LOCAL, upvalue index for UPVALUE
+    std::any* global = nullptr; // for GLOBAL
+};
+
+// added for fused loops... what a FOR found out about its clauses the first time it ran. A COUNTED loop is
+// `var i = ...; i < limit; i = i + step` with i in a slot, so the Interpreter tests and steps the number in that slot
+// itself instead of evaluating the condition and increment nodes every time around
+enum class LoopState : std::uint8_t { UNCHECKED, GENERIC, COUNTED };
+
+struct CountedLoop {
+    LoopState state = LoopState::UNCHECKED;
+    int slot = 0;                              // the loop variable's
+    BinaryState test = BinaryState::GENERIC;   // one of the NUMBER_ comparisons
+    double step = 0;                           // negative for i = i - n
+    bool constantLimit = false;                // the limit is a number literal, so it's only read once
+    double limit = 0;
+};
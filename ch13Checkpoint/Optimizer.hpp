@@ -0,0 +1,518 @@
+#pragma once
+
+#include <any>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Expr.hpp"
+#include "Interpreter.hpp"
+#include "RuntimeError.hpp"
+#include "Stmt.hpp"
+
+// added for the optimizer... finds which local each variable expression refers to and which locals are ever
+// assigned after their declaration, the same way the Resolver walks scopes. Globals are left out on purpose: they
+// can be redeclared, read before they're defined by a function declared earlier, or assigned from a later REPL line
+class AssignmentScan: public ExprVisitor, public StmtVisitor {
+    public:
+        std::unordered_map<const Expr*, const VAR*> bindings; // variable expression -> the local it reads
+        std::unordered_set<const VAR*> assigned;
+
+        void scan (const std::vector<std::shared_ptr<Stmt>>& statements) { for (const auto& statement : statements) scan(statement); }
+
+    private:
+        std::vector<std::unordered_map<std::string, const VAR*>> scopes; // parameters and other non-var names map to null
+
+        void scan (const std::shared_ptr<Stmt>& stmt) { if (stmt != nullptr) stmt->accept(*this); }
+
+        void scan (const std::shared_ptr<Expr>& expr) { if (expr != nullptr) expr->accept(*this); }
+
+        void declare (const std::string& name, const VAR* declaration) {
+            if (!scopes.empty()) scopes.back()[name] = declaration;
+        }
+
+        const VAR* lookUp (const std::string& name) {
+            for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+                auto found = scope->find(name);
+                if (found != scope->end()) return found->second;
+            }
+            return nullptr;
+        }
+
+        void scanFunction (const std::shared_ptr<Function>& function) {
+            scopes.emplace_back();
+            for (const Token& param : function->params) declare(param.lexeme, nullptr);
+            scan(function->body);
+            scopes.pop_back();
+        }
+
+    public:
+        std::any visitBlockStmt (std::shared_ptr<Block> stmt) override {
+            scopes.emplace_back();
+            scan(stmt->statements);
+            scopes.pop_back();
+            return {};
+        }
+
+        std::any visitCLASSStmt (std::shared_ptr<CLASS> stmt) override {
+            declare(stmt->name.lexeme, nullptr);
+            if (stmt->superclass != nullptr) scan(stmt->superclass);
+            for (const std::shared_ptr<Function>& method : stmt->methods) scanFunction(method);
+            return {};
+        }
+
+        std::any visitExpressionStmt (std::shared_ptr<Expression> stmt) override { scan(stmt->expression); return {}; }
+
+        std::any visitFORStmt (std::shared_ptr<FOR> stmt) override {
+            scopes.emplace_back();
+            scan(stmt->initializer);
+            scan(stmt->condition);
+            scan(stmt->body);
+            scan(stmt->increment);
+            scopes.pop_back();
+            return {};
+        }
+
+        std::any visitFunctionStmt (std::shared_ptr<Function> stmt) override {
+            declare(stmt->name.lexeme, nullptr);
+            scanFunction(stmt);
+            return {};
+        }
+
+        std::any visitIFStmt (std::shared_ptr<IF> stmt) override {
+            scan(stmt->condition);
+            scan(stmt->thenBranch);
+            scan(stmt->elseBranch);
+            return {};
+        }
+
+        std::any visitPRINTStmt (std::shared_ptr<PRINT> stmt) override { scan(stmt->expression); return {}; }
+
+        std::any visitRETURNStmt (std::shared_ptr<RETURN> stmt) override { scan(stmt->value); return {}; }
+
+        std::any visitVARStmt (std::shared_ptr<VAR> stmt) override {
+            scan(stmt->initializer);
+            declare(stmt->name.lexeme, stmt.get());
+            return {};
+        }
+
+        std::any visitWHILEStmt (std::shared_ptr<WHILE> stmt) override {
+            scan(stmt->condition);
+            scan(stmt->body);
+            return {};
+        }
+
+        std::any visitAssignExpr (std::shared_ptr<Assign> expr) override {
+            scan(expr->value);
+            if (const VAR* declaration = lookUp(expr->name.lexeme)) assigned.insert(declaration);
+            return {};
+        }
+
+        std::any visitBinaryExpr (std::shared_ptr<Binary> expr) override { scan(expr->left); scan(expr->right); return {}; }
+
+        std::any visitCallExpr (std::shared_ptr<Call> expr) override {
+            scan(expr->callee);
+            for (const std::shared_ptr<Expr>& argument : expr->arguments) scan(argument);
+            return {};
+        }
+
+        std::any visitGETExpr (std::shared_ptr<GET> expr) override { scan(expr->object); return {}; }
+
+        std::any visitInvokeExpr (std::shared_ptr<Invoke> expr) override {
+            scan(expr->object);
+            for (const std::shared_ptr<Expr>& argument : expr->arguments) scan(argument);
+            return {};
+        }
+
+        std::any visitGroupingExpr (std::shared_ptr<Grouping> expr) override { scan(expr->expression); return {}; }
+
+        std::any visitLiteralExpr (std::shared_ptr<Literal> expr) override { return {}; }
+
+        std::any visitSETExpr (std::shared_ptr<SET> expr) override { scan(expr->object); scan(expr->value); return {}; }
+
+        std::any visitSUPERExpr (std::shared_ptr<SUPER> expr) override { return {}; }
+
+        std::any visitTHISExpr (std::shared_ptr<THIS> expr) override { return {}; }
+
+        std::any visitLogicalExpr (std::shared_ptr<Logical> expr) override { scan(expr->left); scan(expr->right); return {}; }
+
+        std::any visitUnaryExpr (std::shared_ptr<Unary> expr) override { scan(expr->right); return {}; }
+
+        std::any visitVariableExpr (std::shared_ptr<Variable> expr) override {
+            if (const VAR* declaration = lookUp(expr->name.lexeme)) bindings[expr.get()] = declaration;
+            return {};
+        }
+};
+
+// what the optimizer did over the whole run, for --stats
+struct OptimizerStats {
+    long long folded = 0;     // expressions replaced by their value
+    long long propagated = 0; // local reads replaced by the constant the local holds
+    long long removed = 0;    // statements pruned as dead
+    long long fused = 0;      // node pairs replaced by a superinstruction
+};
+
+inline OptimizerStats optimizerStats;
+
+// added for the optimizer... runs after the Resolver and rewrites the tree before it's executed:
+//   - Binary and Unary nodes over literals become the literal they evaluate to
+//   - Logical nodes with a literal on the left become whichever side they would return
+//   - Grouping nodes disappear, they only ever mattered to the parser
+//   - locals that are never assigned after a literal initializer are replaced by that literal where they're read
+//   - updated for dead code elimination... an IF on a literal becomes the branch it takes, a WHILE (or a FOR with
+//     nothing to initialize) on a falsy literal goes away, so does everything after a return in the same list,
+//     expression statements that can't do anything (a literal, a local read, this), and blocks left with nothing in
+//     them. A removed statement comes back as null
+//   - added for superinstructions... a Call on a GET becomes an Invoke, and an IF or WHILE on a comparison gets it as
+//     its test. These were the most common pairs in the profiler's node pair counts over tests/ and bench/ after
+//     Binary > Variable and Binary > Literal, which every Binary fuses for itself the first time it runs
+// Folding is done by the Interpreter itself, so the results are exactly what running the code would give. An
+// operation that would throw (like -"a" or 1 + nil) is left alone so the error still happens at runtime, on its line.
+// Nodes are immutable, so a node with a changed child is rebuilt and the Interpreter's side tables are moved over
+// to the new node. Anything whose children didn't change is returned as is.
+class Optimizer: public ExprVisitor, public StmtVisitor {
+    private:
+        Interpreter& interpreter;
+        std::unordered_map<const Stmt*, int>* lines; // the profiler's statement lines, when it's on
+        AssignmentScan assignments;
+        std::unordered_map<const VAR*, std::any> constants;
+        bool tailCall = false; // the next Call is a return's tail call, which has to stay a Call
+
+    public:
+        Optimizer (Interpreter& interpreter, std::unordered_map<const Stmt*, int>* lines = nullptr)
+            : interpreter{interpreter}, lines{lines} {}
+
+        std::vector<std::shared_ptr<Stmt>> optimize (const std::vector<std::shared_ptr<Stmt>>& statements) {
+            assignments.scan(statements);
+            std::vector<std::shared_ptr<Stmt>> optimized;
+            optimizeAll(statements, optimized);
+            return optimized;
+        }
+
+    private:
+        std::shared_ptr<Expr> optimize (const std::shared_ptr<Expr>& expr) {
+            if (expr == nullptr) return nullptr;
+            return std::any_cast<std::shared_ptr<Expr>>(expr->accept(*this));
+        }
+
+        std::shared_ptr<Stmt> optimize (const std::shared_ptr<Stmt>& stmt) {
+            if (stmt == nullptr) return nullptr;
+            return std::any_cast<std::shared_ptr<Stmt>>(stmt->accept(*this));
+        }
+
+        // returns whether anything in the list changed
+        bool optimizeAll (const std::vector<std::shared_ptr<Stmt>>& statements, std::vector<std::shared_ptr<Stmt>>& optimized) {
+            bool changed = false;
+            optimized.reserve(statements.size());
+            for (size_t i = 0; i < statements.size(); i++) {
+                std::shared_ptr<Stmt> statement = optimize(statements[i]);
+                changed |= statement != statements[i];
+                if (statement == nullptr) continue;
+
+                optimized.push_back(statement);
+                if (dynamic_cast<const RETURN*>(statement.get()) != nullptr && i + 1 < statements.size()) {
+                    optimizerStats.removed += statements.size() - i - 1; // nothing after a return can run
+                    return true;
+                }
+            }
+            return changed;
+        }
+
+        // the body of an IF, WHILE or FOR can't just vanish, so a pruned one becomes an empty block with no slots
+        std::shared_ptr<Stmt> optimizeBranch (const std::shared_ptr<Stmt>& stmt) {
+            std::shared_ptr<Stmt> optimized = optimize(stmt);
+            if (optimized != nullptr || stmt == nullptr) return optimized;
+
+            auto empty = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{});
+            interpreter.resolveScope(empty, false, 0, 0);
+            return empty;
+        }
+
+        // the compare-and-branch superinstruction, the IF or WHILE runs it with Interpreter::test()
+        static Binary* comparison (const std::shared_ptr<Expr>& condition) {
+            auto binary = dynamic_cast<Binary*>(condition.get());
+            if (binary == nullptr) return nullptr;
+
+            switch (binary->op.type) {
+                case Less: case LessEqual: case Greater: case GreaterEqual: case EqualEqual: case BangEqual:
+                    optimizerStats.fused++;
+                    return binary;
+                default:
+                    return nullptr;
+            }
+        }
+
+        std::shared_ptr<Stmt> remove () {
+            optimizerStats.removed++;
+            return nullptr;
+        }
+
+        // evaluating it can't fail and can't change anything, so a statement that only evaluates it can go
+        bool isPure (const std::shared_ptr<Expr>& expr) {
+            if (isLiteral(expr) || dynamic_cast<const THIS*>(expr.get()) != nullptr) return true;
+            // a global might not be defined yet, reading it can still throw
+            if (dynamic_cast<const Variable*>(expr.get()) != nullptr) return interpreter.locals.count(expr) != 0;
+            if (auto logical = dynamic_cast<const Logical*>(expr.get())) return isPure(logical->left) && isPure(logical->right);
+            return false;
+        }
+
+        static bool isLiteral (const std::shared_ptr<Expr>& expr) { return dynamic_cast<const Literal*>(expr.get()) != nullptr; }
+
+        static const std::any& literal (const std::shared_ptr<Expr>& expr) { return static_cast<const Literal*>(expr.get())->value; }
+
+        // the interpreter evaluates it, so folding can never disagree with running. Returns the node as is if it throws
+        std::shared_ptr<Expr> fold (const std::shared_ptr<Expr>& expr) {
+            try {
+                std::shared_ptr<Expr> folded = std::make_shared<Literal>(interpreter.eval(expr));
+                optimizerStats.folded++;
+                return folded;
+            } catch (RuntimeError&) {
+                return expr;
+            }
+        }
+
+        std::shared_ptr<Expr> replace (const std::shared_ptr<Expr>& from, std::shared_ptr<Expr> to) {
+            interpreter.replace(from, to);
+            return to;
+        }
+
+        std::shared_ptr<Stmt> replace (const std::shared_ptr<Stmt>& from, std::shared_ptr<Stmt> to) {
+            interpreter.replace(from, to);
+            if (lines != nullptr) {
+                auto line = lines->find(from.get());
+                if (line != lines->end()) (*lines)[to.get()] = line->second;
+            }
+            return to;
+        }
+
+    public:
+        std::any visitBlockStmt (std::shared_ptr<Block> stmt) override {
+            std::vector<std::shared_ptr<Stmt>> statements;
+            bool changed = optimizeAll(stmt->statements, statements);
+            if (statements.empty()) return remove();
+            if (!changed) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<Block>(std::move(statements)));
+        }
+
+        std::any visitCLASSStmt (std::shared_ptr<CLASS> stmt) override {
+            std::vector<std::shared_ptr<Function>> methods;
+            bool changed = false;
+            for (const std::shared_ptr<Function>& method : stmt->methods) {
+                methods.push_back(std::static_pointer_cast<Function>(optimize(std::shared_ptr<Stmt>{method})));
+                changed |= methods.back() != method;
+            }
+
+            if (!changed) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<CLASS>(stmt->name, stmt->superclass, std::move(methods)));
+        }
+
+        std::any visitExpressionStmt (std::shared_ptr<Expression> stmt) override {
+            std::shared_ptr<Expr> expression = optimize(stmt->expression);
+            if (isPure(expression)) return remove();
+            if (expression == stmt->expression) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<Expression>(expression));
+        }
+
+        // a FOR on a falsy literal still runs its initializer, which keeps it unless that's missing or only an expression
+        std::any visitFORStmt (std::shared_ptr<FOR> stmt) override {
+            std::shared_ptr<Stmt> initializer = optimize(stmt->initializer);
+            std::shared_ptr<Expr> condition = optimize(stmt->condition);
+            if (isLiteral(condition) && !interpreter.isTruther(literal(condition))) {
+                if (initializer == nullptr) return remove();
+                if (dynamic_cast<const Expression*>(initializer.get()) != nullptr) {
+                    optimizerStats.removed++;
+                    return initializer;
+                }
+            }
+
+            std::shared_ptr<Expr> increment = optimize(stmt->increment);
+            std::shared_ptr<Stmt> body = optimizeBranch(stmt->body);
+            if (initializer == stmt->initializer && condition == stmt->condition && increment == stmt->increment && body == stmt->body) {
+                return std::shared_ptr<Stmt>{stmt};
+            }
+            return replace(stmt, std::make_shared<FOR>(initializer, condition, increment, body));
+        }
+
+        std::any visitFunctionStmt (std::shared_ptr<Function> stmt) override {
+            std::vector<std::shared_ptr<Stmt>> body;
+            if (!optimizeAll(stmt->body, body)) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<Function>(stmt->name, stmt->params, std::move(body)));
+        }
+
+        std::any visitIFStmt (std::shared_ptr<IF> stmt) override {
+            std::shared_ptr<Expr> condition = optimize(stmt->condition);
+
+            // the branch not taken is gone, and the one taken stands in for the whole IF. A branch can't be a
+            // declaration, so it doesn't matter that it moves out of the IF
+            if (isLiteral(condition)) {
+                optimizerStats.removed++;
+                std::shared_ptr<Stmt> taken = interpreter.isTruther(literal(condition)) ? stmt->thenBranch : stmt->elseBranch;
+                return optimize(taken);
+            }
+
+            std::shared_ptr<Stmt> thenBranch = optimizeBranch(stmt->thenBranch);
+            std::shared_ptr<Stmt> elseBranch = optimize(stmt->elseBranch);
+
+            std::shared_ptr<IF> result = stmt;
+            if (condition != stmt->condition || thenBranch != stmt->thenBranch || elseBranch != stmt->elseBranch) {
+                result = std::make_shared<IF>(condition, thenBranch, elseBranch);
+                replace(stmt, result);
+            }
+            result->test = comparison(result->condition);
+            return std::shared_ptr<Stmt>{result};
+        }
+
+        std::any visitPRINTStmt (std::shared_ptr<PRINT> stmt) override {
+            std::shared_ptr<Expr> expression = optimize(stmt->expression);
+            if (expression == stmt->expression) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<PRINT>(expression));
+        }
+
+        std::any visitRETURNStmt (std::shared_ptr<RETURN> stmt) override {
+            tailCall = interpreter.tailCalls.count(stmt) != 0;
+            std::shared_ptr<Expr> value = optimize(stmt->value);
+            if (value == stmt->value) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<RETURN>(stmt->keyword, value));
+        }
+
+        std::any visitVARStmt (std::shared_ptr<VAR> stmt) override {
+            std::shared_ptr<Expr> initializer = optimize(stmt->initializer);
+
+            if (assignments.assigned.count(stmt.get()) == 0) {
+                if (initializer == nullptr) constants[stmt.get()] = nullptr;
+                else if (isLiteral(initializer)) constants[stmt.get()] = literal(initializer);
+            }
+
+            if (initializer == stmt->initializer) return std::shared_ptr<Stmt>{stmt};
+            return replace(stmt, std::make_shared<VAR>(stmt->name, initializer));
+        }
+
+        std::any visitWHILEStmt (std::shared_ptr<WHILE> stmt) override {
+            std::shared_ptr<Expr> condition = optimize(stmt->condition);
+            if (isLiteral(condition) && !interpreter.isTruther(literal(condition))) return remove();
+
+            std::shared_ptr<Stmt> body = optimizeBranch(stmt->body);
+            std::shared_ptr<WHILE> result = stmt;
+            if (condition != stmt->condition || body != stmt->body) {
+                result = std::make_shared<WHILE>(condition, body);
+                replace(stmt, result);
+            }
+            result->test = comparison(result->condition);
+            return std::shared_ptr<Stmt>{result};
+        }
+
+        std::any visitAssignExpr (std::shared_ptr<Assign> expr) override {
+            std::shared_ptr<Expr> value = optimize(expr->value);
+            if (value == expr->value) return std::shared_ptr<Expr>{expr};
+            return replace(expr, std::make_shared<Assign>(expr->name, value));
+        }
+
+        std::any visitBinaryExpr (std::shared_ptr<Binary> expr) override {
+            std::shared_ptr<Expr> left = optimize(expr->left);
+            std::shared_ptr<Expr> right = optimize(expr->right);
+
+            std::shared_ptr<Expr> result = expr;
+            if (left != expr->left || right != expr->right) result = std::make_shared<Binary>(left, expr->op, right);
+            if (isLiteral(left) && isLiteral(right)) return fold(result);
+            return result;
+        }
+
+        std::any visitCallExpr (std::shared_ptr<Call> expr) override {
+            bool fuse = !tailCall;
+            tailCall = false;
+
+            std::shared_ptr<Expr> callee = optimize(expr->callee);
+            bool changed = callee != expr->callee;
+
+            std::vector<std::shared_ptr<Expr>> arguments;
+            for (const std::shared_ptr<Expr>& argument : expr->arguments) {
+                arguments.push_back(optimize(argument));
+                changed |= arguments.back() != argument;
+            }
+
+            if (auto get = dynamic_cast<const GET*>(callee.get()); fuse && get != nullptr) {
+                optimizerStats.fused++;
+                return replace(expr, std::make_shared<Invoke>(get->object, get->name, expr->paren, std::move(arguments)));
+            }
+
+            if (!changed) return std::shared_ptr<Expr>{expr};
+            return replace(expr, std::make_shared<Call>(callee, expr->paren, std::move(arguments)));
+        }
+
+        std::any visitGETExpr (std::shared_ptr<GET> expr) override {
+            std::shared_ptr<Expr> object = optimize(expr->object);
+            if (object == expr->object) return std::shared_ptr<Expr>{expr};
+            return replace(expr, std::make_shared<GET>(object, expr->name));
+        }
+
+        std::any visitGroupingExpr (std::shared_ptr<Grouping> expr) override { return optimize(expr->expression); }
+
+        std::any visitInvokeExpr (std::shared_ptr<Invoke> expr) override {
+            std::shared_ptr<Expr> object = optimize(expr->object);
+            bool changed = object != expr->object;
+
+            std::vector<std::shared_ptr<Expr>> arguments;
+            for (const std::shared_ptr<Expr>& argument : expr->arguments) {
+                arguments.push_back(optimize(argument));
+                changed |= arguments.back() != argument;
+            }
+
+            if (!changed) return std::shared_ptr<Expr>{expr};
+            return replace(expr, std::make_shared<Invoke>(object, expr->name, expr->paren, std::move(arguments)));
+        }
+
+        std::any visitLiteralExpr (std::shared_ptr<Literal> expr) override { return std::shared_ptr<Expr>{expr}; }
+
+        std::any visitSETExpr (std::shared_ptr<SET> expr) override {
+            std::shared_ptr<Expr> object = optimize(expr->object);
+            std::shared_ptr<Expr> value = optimize(expr->value);
+            if (object == expr->object && value == expr->value) return std::shared_ptr<Expr>{expr};
+            return replace(expr, std::make_shared<SET>(object, expr->name, value));
+        }
+
+        std::any visitSUPERExpr (std::shared_ptr<SUPER> expr) override { return std::shared_ptr<Expr>{expr}; }
+
+        std::any visitTHISExpr (std::shared_ptr<THIS> expr) override { return std::shared_ptr<Expr>{expr}; }
+
+        // a and b / a or b return one of their operands, so a literal on the left decides which one right now
+        std::any visitLogicalExpr (std::shared_ptr<Logical> expr) override {
+            std::shared_ptr<Expr> left = optimize(expr->left);
+            std::shared_ptr<Expr> right = optimize(expr->right);
+
+            if (isLiteral(left)) {
+                optimizerStats.folded++;
+                bool truthy = interpreter.isTruther(literal(left));
+                if (expr->op.type == Or) return truthy ? left : right;
+                return truthy ? right : left;
+            }
+
+            if (left == expr->left && right == expr->right) return std::shared_ptr<Expr>{expr};
+            return replace(expr, std::make_shared<Logical>(left, expr->op, right));
+        }
+
+        std::any visitUnaryExpr (std::shared_ptr<Unary> expr) override {
+            std::shared_ptr<Expr> right = optimize(expr->right);
+
+            std::shared_ptr<Expr> result = expr;
+            if (right != expr->right) result = std::make_shared<Unary>(expr->op, right);
+            if (isLiteral(right)) return fold(result);
+            return result;
+        }
+
+        std::any visitVariableExpr (std::shared_ptr<Variable> expr) override {
+            auto binding = assignments.bindings.find(expr.get());
+            if (binding != assignments.bindings.end()) {
+                auto constant = constants.find(binding->second);
+                if (constant != constants.end()) {
+                    optimizerStats.propagated++;
+                    interpreter.forget(expr);
+                    return std::shared_ptr<Expr>{std::make_shared<Literal>(constant->second)};
+                }
+            }
+
+            return std::shared_ptr<Expr>{expr};
+        }
+};
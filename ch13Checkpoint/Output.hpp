@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// isatty is POSIX. Anywhere else stdout is treated as a terminal and every line goes out as it's printed
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// added for buffered output... print statements land in one big user-space buffer that goes out in a single write
+// once it passes the threshold, when someone asks (errors, the REPL prompt), or at exit. If stdout is a terminal we
+// flush every line instead so the REPL still feels interactive
+class Output {
+    private:
+        std::string buffer;
+        size_t threshold;
+        bool lineBuffered;
+
+    public:
+        static constexpr size_t DEFAULT_THRESHOLD = 1 << 16;
+
+        Output (size_t threshold = DEFAULT_THRESHOLD) : threshold{threshold}, lineBuffered{stdoutIsTerminal()} {
+            buffer.reserve(threshold);
+        }
+
+        ~Output () { flush(); }
+
+        void setThreshold (size_t bytes) {
+            threshold = bytes;
+            if (buffer.size() >= threshold) flush();
+        }
+
+        void write (std::string_view text) {
+            buffer.append(text);
+            if (buffer.size() >= threshold) flush();
+        }
+
+        // one print statement's worth of output
+        void writeLine (std::string_view text) {
+            buffer.append(text);
+            buffer.push_back('\n');
+            if (lineBuffered || buffer.size() >= threshold) flush();
+        }
+
+        void flush () {
+            if (buffer.empty()) return;
+            std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+            std::fflush(stdout);
+            buffer.clear();
+        }
+
+    private:
+        static bool stdoutIsTerminal () {
+#if defined(__unix__) || defined(__APPLE__)
+            return isatty(fileno(stdout)) != 0;
+#else
+            return true;
+#endif
+        }
+};
+
+inline Output output;
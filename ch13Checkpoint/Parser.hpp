@@ -5,6 +5,7 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>      
 #include <vector>
 
@@ -36,6 +37,8 @@ class Parser {
             return statements;
         }
 
+        std::unordered_map<const Stmt*, int>* lines = nullptr; // statement -> source line, only filled in for the profiler
+
     private: 
         const std::vector<Token>& tokens; 
         int curr = 0; // used to point to next tokens
@@ -62,10 +65,11 @@ class Parser {
 
         // declaration    → classDecl | funDecl | varDecl | statement ;
         std::shared_ptr<Stmt> declaration() {
+            int line = peek().line;
             try {
-                if (matchMe(Class)) return classDeclaration(); // added in ch12
-                if (matchMe(Fun)) return function("function");
-                if (matchMe(Var)) return varDec();
+                if (matchMe(Class)) return mark(line, classDeclaration()); // added in ch12
+                if (matchMe(Fun)) return mark(line, function("function"));
+                if (matchMe(Var)) return mark(line, varDec());
 
                 return statement();
             } catch (ParseError error) {
@@ -211,13 +215,20 @@ class Parser {
 
         // statement      → exprStmt | forStmt | ifStmt | printStmt | returnStmt | whileStmt | block ;
         std::shared_ptr<Stmt> statement() { // added in ch08
-            if (matchMe(For)) return forStatement(); // added in ch09
-            if (matchMe(If)) return ifStatement(); // added in ch09
-            if (matchMe(While)) return whileStatement(); // added in ch09
-            if (matchMe(Print)) return printStatement();
-            if (matchMe(Return)) return returnStatement(); // added in ch10
-            if (matchMe(OpenBrace)) return std::make_shared<Block>(block());
-            return expressionStatement();
+            int line = peek().line;
+            if (matchMe(For)) return mark(line, forStatement()); // added in ch09
+            if (matchMe(If)) return mark(line, ifStatement()); // added in ch09
+            if (matchMe(While)) return mark(line, whileStatement()); // added in ch09
+            if (matchMe(Print)) return mark(line, printStatement());
+            if (matchMe(Return)) return mark(line, returnStatement()); // added in ch10
+            if (matchMe(OpenBrace)) return mark(line, std::make_shared<Block>(block()));
+            return mark(line, expressionStatement());
+        }
+
+        // added for the profiler... statements don't carry a token of their own, so it gets their lines from here
+        std::shared_ptr<Stmt> mark (int line, std::shared_ptr<Stmt> stmt) {
+            if (lines != nullptr) (*lines)[stmt.get()] = line;
+            return stmt;
         }
 
         // returnStmt     → "return" expression? ";" ; ... added in ch10
@@ -278,18 +289,20 @@ class Parser {
 
             // body
             std::shared_ptr<Stmt> body = statement();
-            if (increment != nullptr) {
-                body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{body, std::make_shared<Expression>(increment)});
-            }
+            // if (increment != nullptr) {
+            //     body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{body, std::make_shared<Expression>(increment)});
+            // }
 
-            if (condition == nullptr) condition = std::make_shared<Literal>(true);
-            body = std::make_shared<WHILE>(condition, body);
+            // if (condition == nullptr) condition = std::make_shared<Literal>(true);
+            // body = std::make_shared<WHILE>(condition, body);
 
-            if (initilaizer != nullptr) {
-                body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{initilaizer, body});
-            }
+            // if (initilaizer != nullptr) {
+            //     body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{initilaizer, body});
+            // }
 
-            return body;
+            // return body;
+            // updated for fused loops... no more desugaring into a Block + WHILE + Block, a missing condition means forever
+            return std::make_shared<FOR>(initilaizer, condition, increment, body);
         }
 
         void sync() { // help avoid cascade errors
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Interpreter.hpp"
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxNative.hpp"
+#include "Output.hpp"
+
+// added for the profiler... an Interpreter whose statement visitors and calls are wrapped in timers. It's a subclass
+// so a plain Interpreter never pays for any of it, the profiling code only runs through this class's vtable.
+// It counts executions and self/inclusive time per source line and per function, and reports to stderr when destroyed.
+class ProfilingInterpreter: public Interpreter {
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string label;
+        long long count = 0;
+        Clock::duration self{0};
+        Clock::duration inclusive{0};
+        int active = 0; // > 1 while recursing, inclusive time is only added by the outermost one
+    };
+
+    struct Active {
+        Entry* entry;
+        Clock::time_point start;
+        Clock::duration children;
+    };
+
+    std::unordered_map<int, Entry> lineEntries;
+    std::unordered_map<const void*, Entry> functionEntries;
+    std::vector<Active> lineStack;
+    std::vector<Active> functionStack;
+    // std::map<std::pair<const char*, const char*>, long long> nodePairs; // each node kind's name is a single literal
+    // const char* parentNode = "<script>";
+    // updated for superinstructions... a flat table indexed by node kind, so counting a pair is one increment instead
+    // of a map lookup inside the timed regions. 0 is the script itself, then every StmtKind, then every ExprKind
+    static constexpr size_t STMT_KINDS = static_cast<size_t>(StmtKind::WHILE) + 1;
+    static constexpr size_t NODE_KINDS = 1 + STMT_KINDS + static_cast<size_t>(ExprKind::Variable) + 1;
+    static constexpr const char* NODE_NAMES[NODE_KINDS] = {
+        "<script>", "Block", "CLASS", "Expression", "FOR", "Function", "IF", "PRINT", "RETURN", "VAR", "WHILE",
+        "Assign", "Binary", "Call", "Invoke", "GET", "Grouping", "Literal", "SET", "SUPER", "THIS", "Logical", "Unary",
+        "Variable"
+    };
+    long long nodePairs[NODE_KINDS][NODE_KINDS] = {};
+    size_t parentNode = 0;
+
+    static constexpr size_t node (StmtKind kind) { return 1 + static_cast<size_t>(kind); }
+    static constexpr size_t node (ExprKind kind) { return 1 + STMT_KINDS + static_cast<size_t>(kind); }
+
+    public:
+        std::unordered_map<const Stmt*, int> lines; // handed to the Parser so statements can be mapped to lines
+
+        ProfilingInterpreter () {
+            directDispatch = false; // it would jump past these overrides
+        }
+
+        ~ProfilingInterpreter () { report(std::cerr); }
+
+        void report (std::ostream& out) {
+            output.flush(); // keep the script's own output ahead of the report
+            printTable(out, "functions", functionEntries, functionEntries.size());
+            printTable(out, "lines", lineEntries, 20);
+            printPairs(out, 20);
+        }
+
+        std::any visitBlockStmt (std::shared_ptr<Block> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::Block), [&]() { return Interpreter::visitBlockStmt(stmt); });
+        }
+
+        std::any visitCLASSStmt (std::shared_ptr<CLASS> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::CLASS), [&]() { return Interpreter::visitCLASSStmt(stmt); });
+        }
+
+        std::any visitExpressionStmt (std::shared_ptr<Expression> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::Expression), [&]() { return Interpreter::visitExpressionStmt(stmt); });
+        }
+
+        std::any visitFORStmt (std::shared_ptr<FOR> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::FOR), [&]() { return Interpreter::visitFORStmt(stmt); });
+        }
+
+        std::any visitFunctionStmt (std::shared_ptr<Function> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::Function), [&]() { return Interpreter::visitFunctionStmt(stmt); });
+        }
+
+        std::any visitIFStmt (std::shared_ptr<IF> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::IF), [&]() { return Interpreter::visitIFStmt(stmt); });
+        }
+
+        std::any visitPRINTStmt (std::shared_ptr<PRINT> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::PRINT), [&]() { return Interpreter::visitPRINTStmt(stmt); });
+        }
+
+        std::any visitRETURNStmt (std::shared_ptr<RETURN> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::RETURN), [&]() { return Interpreter::visitRETURNStmt(stmt); });
+        }
+
+        std::any visitVARStmt (std::shared_ptr<VAR> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::VAR), [&]() { return Interpreter::visitVARStmt(stmt); });
+        }
+
+        std::any visitWHILEStmt (std::shared_ptr<WHILE> stmt) override {
+            return profileLine(stmt.get(), node(StmtKind::WHILE), [&]() { return Interpreter::visitWHILEStmt(stmt); });
+        }
+
+        std::any visitAssignExpr (std::shared_ptr<Assign> expr) override {
+            return countPair(node(ExprKind::Assign), [&]() { return Interpreter::visitAssignExpr(expr); });
+        }
+
+        std::any visitBinaryExpr (std::shared_ptr<Binary> expr) override {
+            return countPair(node(ExprKind::Binary), [&]() { return Interpreter::visitBinaryExpr(expr); });
+        }
+
+        std::any visitGETExpr (std::shared_ptr<GET> expr) override {
+            return countPair(node(ExprKind::GET), [&]() { return Interpreter::visitGETExpr(expr); });
+        }
+
+        std::any visitGroupingExpr (std::shared_ptr<Grouping> expr) override {
+            return countPair(node(ExprKind::Grouping), [&]() { return Interpreter::visitGroupingExpr(expr); });
+        }
+
+        std::any visitLiteralExpr (std::shared_ptr<Literal> expr) override {
+            return countPair(node(ExprKind::Literal), [&]() { return Interpreter::visitLiteralExpr(expr); });
+        }
+
+        std::any visitSETExpr (std::shared_ptr<SET> expr) override {
+            return countPair(node(ExprKind::SET), [&]() { return Interpreter::visitSETExpr(expr); });
+        }
+
+        std::any visitSUPERExpr (std::shared_ptr<SUPER> expr) override {
+            return countPair(node(ExprKind::SUPER), [&]() { return Interpreter::visitSUPERExpr(expr); });
+        }
+
+        std::any visitTHISExpr (std::shared_ptr<THIS> expr) override {
+            return countPair(node(ExprKind::THIS), [&]() { return Interpreter::visitTHISExpr(expr); });
+        }
+
+        std::any visitLogicalExpr (std::shared_ptr<Logical> expr) override {
+            return countPair(node(ExprKind::Logical), [&]() { return Interpreter::visitLogicalExpr(expr); });
+        }
+
+        std::any visitUnaryExpr (std::shared_ptr<Unary> expr) override {
+            return countPair(node(ExprKind::Unary), [&]() { return Interpreter::visitUnaryExpr(expr); });
+        }
+
+        std::any visitVariableExpr (std::shared_ptr<Variable> expr) override {
+            return countPair(node(ExprKind::Variable), [&]() { return Interpreter::visitVariableExpr(expr); });
+        }
+
+        // same as Interpreter::visitCallExpr, but the call itself (not the arguments) is timed against the callee
+        std::any visitCallExpr (std::shared_ptr<Call> expr) override {
+            return countPair(node(ExprKind::Call), [&]() { return profileCall(expr); });
+        }
+
+        // same as Interpreter::visitInvokeExpr, with the call timed the same way
+        std::any visitInvokeExpr (std::shared_ptr<Invoke> expr) override {
+            return countPair(node(ExprKind::Invoke), [&]() { return profileInvoke(expr); });
+        }
+
+    private:
+        std::any profileInvoke (const std::shared_ptr<Invoke>& expr) {
+            std::any object = eval(expr->object);
+            std::any callee;
+            std::shared_ptr<LoxFunction> method = lookUpInvoke(*expr, object, callee);
+            size_t frame = pushArguments(expr->arguments, expr->paren);
+            Entry* entry = functionEntry(method != nullptr ? std::any{method} : callee);
+
+            try {
+                auto call = [&]() {
+                    if (method != nullptr) return callMethod(*method, object, expr->paren, frame, expr->arguments.size());
+                    return callValue(callee, expr->paren, frame, expr->arguments.size());
+                };
+                std::any result = entry != nullptr ? profile(functionStack, *entry, call) : call();
+                popArguments(frame);
+                return result;
+            } catch (...) {
+                popArguments(frame);
+                throw;
+            }
+        }
+
+        std::any profileCall (const std::shared_ptr<Call>& expr) {
+            std::any callee = eval(expr->callee);
+            size_t frame = pushArguments(expr->arguments, expr->paren);
+            Entry* entry = functionEntry(callee);
+
+            try {
+                auto call = [&]() { return callValue(callee, expr->paren, frame, expr->arguments.size()); };
+                std::any result = entry != nullptr ? profile(functionStack, *entry, call) : call();
+                popArguments(frame);
+                return result;
+            } catch (...) {
+                popArguments(frame);
+                throw;
+            }
+        }
+
+        // added for tail calls... the caller's time stops and the callee's starts here, the same as a return and a call.
+        // The profile() around the original call then leaves whichever function ends up returning
+        void tailCall (const std::any& callee) override {
+            nodePairs[node(StmtKind::RETURN)][node(ExprKind::Call)]++; // the tail call skips visitCallExpr
+            Entry* entry = functionEntry(callee);
+            if (entry == nullptr) return; // not callable, callValue() reports it and the caller's entry unwinds with it
+            leave(functionStack);
+            enter(functionStack, *entry);
+        }
+
+        template <typename Body>
+        std::any profile (std::vector<Active>& stack, Entry& entry, Body&& body) {
+            enter(stack, entry);
+
+            try {
+                std::any result = body();
+                leave(stack);
+                return result;
+            } catch (...) { // returns and runtime errors unwind through here too
+                leave(stack);
+                throw;
+            }
+        }
+
+        void enter (std::vector<Active>& stack, Entry& entry) {
+            entry.count++;
+            entry.active++;
+            stack.push_back(Active{&entry, Clock::now(), Clock::duration{0}});
+        }
+
+        void leave (std::vector<Active>& stack) {
+            Active done = stack.back();
+            stack.pop_back();
+
+            Clock::duration elapsed = Clock::now() - done.start;
+            done.entry->self += elapsed - done.children;
+            if (--done.entry->active == 0) done.entry->inclusive += elapsed;
+            if (!stack.empty()) stack.back().children += elapsed;
+        }
+
+        // statements the parser made up (the pieces of a desugared for) have no line, they count toward their parent
+        template <typename Body>
+        std::any profileLine (const Stmt* stmt, size_t kind, Body&& body) {
+            auto line = lines.find(stmt);
+            if (line == lines.end()) return countPair(kind, body);
+
+            Entry& entry = lineEntries[line->second];
+            if (entry.label.empty()) entry.label = "line " + std::to_string(line->second);
+            // return profile(lineStack, entry, [&]() { return countPair(node, body); });
+            return countPair(kind, [&]() { return profile(lineStack, entry, body); }); // the line's time leaves out the counting
+        }
+
+        // added for superinstructions... which node runs right under which, the tree-walker's version of a VM's
+        // opcode pairs. The most common pairs are the ones worth fusing into a single node
+        template <typename Body>
+        std::any countPair (size_t kind, Body&& body) {
+            nodePairs[parentNode][kind]++;
+            size_t enclosing = parentNode;
+            parentNode = kind;
+            try {
+                std::any result = body();
+                parentNode = enclosing;
+                return result;
+            } catch (...) {
+                parentNode = enclosing;
+                throw;
+            }
+        }
+
+        void printPairs (std::ostream& out, size_t limit) {
+            std::vector<std::pair<std::pair<const char*, const char*>, long long>> sorted;
+            for (size_t parent = 0; parent < NODE_KINDS; parent++) {
+                for (size_t child = 0; child < NODE_KINDS; child++) {
+                    if (nodePairs[parent][child] != 0) sorted.push_back({{NODE_NAMES[parent], NODE_NAMES[child]}, nodePairs[parent][child]});
+                }
+            }
+            if (sorted.empty()) return;
+
+            std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+            if (sorted.size() > limit) sorted.resize(limit);
+
+            out << "== profile: node pairs by count ==\n";
+            out << std::setw(12) << "count" << "  parent > child\n";
+            for (const auto& [pair, count] : sorted) out << std::setw(12) << count << "  " << pair.first << " > " << pair.second << "\n";
+        }
+
+        Entry* functionEntry (const std::any& callee) {
+            const void* key;
+            std::string label;
+
+            // methods are keyed by declaration, so every bound copy of one lands in the same entry
+            if (auto function = callableOf<LoxFunction>(callee, CallableKind::FUNCTION)) {
+                key = function->declaration.get();
+                if (functionEntries.count(key) == 0) {
+                    label = function->declaration->name.lexeme + "() line " + std::to_string(function->declaration->name.line);
+                }
+            }
+            else if (auto klass = callableOf<LoxClass>(callee, CallableKind::CLASS)) {
+                key = klass.get();
+                if (functionEntries.count(key) == 0) label = klass->toString() + "() [class]";
+            }
+            else if (auto native = callableOf<LoxNative>(callee, CallableKind::NATIVE)) {
+                key = native.get();
+                if (functionEntries.count(key) == 0) label = native->name + "() [native]";
+            }
+            else return nullptr;
+
+            Entry& entry = functionEntries[key];
+            if (entry.label.empty()) entry.label = std::move(label);
+            return &entry;
+        }
+
+        template <typename Key>
+        static void printTable (std::ostream& out, const char* title, const std::unordered_map<Key, Entry>& entries, size_t limit) {
+            if (entries.empty()) return;
+
+            std::vector<const Entry*> sorted;
+            for (const auto& [key, entry] : entries) sorted.push_back(&entry);
+            std::sort(sorted.begin(), sorted.end(), [](const Entry* a, const Entry* b) { return a->self > b->self; });
+            if (sorted.size() > limit) sorted.resize(limit);
+
+            auto ms = [](Clock::duration time) { return std::chrono::duration<double, std::milli>{time}.count(); };
+
+            out << "== profile: " << title << " by self time ==\n";
+            out << std::setw(12) << "count" << std::setw(14) << "self ms" << std::setw(14) << "inclusive ms" << "  " << title << "\n";
+            out << std::fixed << std::setprecision(3);
+            for (const Entry* entry : sorted) {
+                out << std::setw(12) << entry->count << std::setw(14) << ms(entry->self)
+                    << std::setw(14) << ms(entry->inclusive) << "  " << entry->label << "\n";
+            }
+            out << std::defaultfloat;
+        }
+};
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "Interpreter.hpp"
@@ -10,7 +13,30 @@
 class Resolver: public ExprVisitor, public StmtVisitor {
     private:
         Interpreter& interpreter;
-        std::vector<std::unordered_map<std::string, bool>> scopes;
+
+        // every local gets a stack slot in its function's frame. A closure that reaches into an enclosing function
+        // gets the local through an upvalue instead (updated for upvalue closures, like clox does it)
+        struct Local {
+            bool defined; // false means declared but not defined
+            int slot;
+        };
+
+        struct Scope {
+            std::unordered_map<std::string, Local> locals;
+            int function;  // index into functions of the function that owns this scope
+            int slotStart;
+            bool captured = false; // some closure holds an upvalue to one of our locals
+        };
+
+        // what a function being resolved captures from the functions around it
+        struct FunctionState {
+            std::vector<Interpreter::Capture> upvalues;
+            int maxSlots = 0;
+        };
+
+        std::vector<Scope> scopes;
+        std::vector<FunctionState> functions{1}; // functions[0] is the top-level script
+        int nextSlot = 0;
 
         enum class FunctionType {
             NONE,
@@ -33,45 +59,105 @@ class Resolver: public ExprVisitor, public StmtVisitor {
 
         void resolve (const std::shared_ptr<Expr>& expr) { expr->accept(*this); }
 
-        void endScope () { scopes.pop_back(); }
+        Scope endScope () {
+            Scope scope = std::move(scopes.back());
+            scopes.pop_back();
+            nextSlot = scope.slotStart;
+            return scope;
+        }
+
+        int addLocal (const std::string& name, bool defined) {
+            int slot = nextSlot++;
+            functions.back().maxSlots = std::max(functions.back().maxSlots, nextSlot);
+            scopes.back().locals[name] = Local{defined, slot};
+            return slot;
+        }
 
         void declare (const Token& name) {
             if (scopes.empty()) return;
 
-            std::unordered_map<std::string, bool>& scope = scopes.back();
+            std::unordered_map<std::string, Local>& scope = scopes.back().locals;
             if (scope.find(name.lexeme) != scope.end()) {
                 error(name, "Already a variable with this name in this scope.");
             }
 
-            scope[name.lexeme] = false; // false means declared but not defined
+            addLocal(name.lexeme, false);
+        }
+
+        // added for escape analysis... declarations that are statements (var, fun, class) get their slot recorded
+        void declare (const std::shared_ptr<Stmt>& stmt, const Token& name) {
+            declare(name);
+            if (!scopes.empty()) interpreter.resolve(stmt, scopes.back().locals[name.lexeme].slot);
         }
 
         void define (const Token& name) {
             if (scopes.empty()) return;
-            scopes.back()[name.lexeme] = true; // true means defined
+            scopes.back().locals[name.lexeme].defined = true;
         }
 
-        void resolveLocal (const std::shared_ptr<Expr>& expr, const Token& name) {
+        // returns false for globals
+        bool findLocal (const std::string& name, Interpreter::Local& local) {
             for (int i = scopes.size() - 1; i >= 0; --i) {
-                if (scopes[i].find(name.lexeme) != scopes[i].end()) {
-                    interpreter.resolve(expr, scopes.size() - 1 - i);
-                    return;
+                auto found = scopes[i].locals.find(name);
+                if (found == scopes[i].locals.end()) continue;
+
+                int function = functions.size() - 1;
+                if (scopes[i].function == function) local = {found->second.slot, -1};
+                else {
+                    scopes[i].captured = true;
+                    local = {-1, resolveUpvalue(function, scopes[i].function, found->second.slot)};
                 }
+                return true;
             }
+
+            return false;
+        }
+
+        // added for upvalue closures... threads the capture through every function between the declaring one and the user
+        int resolveUpvalue (int function, int declaringFunction, int slot) {
+            if (function - 1 == declaringFunction) return addUpvalue(function, true, slot);
+            return addUpvalue(function, false, resolveUpvalue(function - 1, declaringFunction, slot));
+        }
+
+        int addUpvalue (int function, bool isLocal, int index) {
+            std::vector<Interpreter::Capture>& upvalues = functions[function].upvalues;
+            for (int i = 0; i < upvalues.size(); ++i) {
+                if (upvalues[i].isLocal == isLocal && upvalues[i].index == index) return i;
+            }
+
+            upvalues.push_back(Interpreter::Capture{isLocal, index});
+            return upvalues.size() - 1;
+        }
+
+        void resolveLocal (const std::shared_ptr<Expr>& expr, const Token& name) {
+            Interpreter::Local local;
+            if (findLocal(name.lexeme, local)) interpreter.resolve(expr, local);
         }
 
         void resolveFunction (const std::shared_ptr<Function>& function, FunctionType type) {
             FunctionType enclosingFunction = currentFunction;
             currentFunction = type;
 
+            // each function gets a fresh frame, so its slots start back at 0
+            int enclosingSlot = nextSlot;
+            nextSlot = 0;
+            functions.emplace_back();
+
             beginScope();
+            // methods keep their receiver in slot 0... updated for upvalue closures
+            // every frame saves slot 0 for it so arguments always start at slot 1 (nothing can name "")
+            addLocal(type == FunctionType::METHOD || type == FunctionType::INITIALIZER ? "this" : "", true);
             for (const Token& param : function->params) {
                 declare(param);
                 define(param);
             }
             resolve(function->body);
-            endScope();
+            Scope scope = endScope();
+            interpreter.resolveScope(function, scope.captured, scope.slotStart, functions.back().maxSlots);
+            interpreter.resolveCaptures(function, std::move(functions.back().upvalues));
 
+            functions.pop_back();
+            nextSlot = enclosingSlot;
             currentFunction = enclosingFunction;
         }
 
@@ -82,12 +168,33 @@ class Resolver: public ExprVisitor, public StmtVisitor {
             for (const std::shared_ptr<Stmt>& statement : statements) resolve(statement);
         }
 
-        void beginScope () { scopes.push_back(std::unordered_map<std::string, bool>()); }
+        void beginScope () {
+            Scope scope;
+            scope.function = functions.size() - 1;
+            scope.slotStart = nextSlot;
+            scopes.push_back(std::move(scope));
+        }
 
         std::any visitBlockStmt (std::shared_ptr<Block> stmt) override {
             beginScope();
             resolve(stmt->statements);
-            endScope();
+            int slotEnd = nextSlot;
+            Scope scope = endScope();
+            interpreter.resolveScope(stmt, scope.captured, scope.slotStart, slotEnd);
+            return nullptr;
+        }
+
+        // added for fused loops... the initializer's variable belongs to the loop's own scope, like the Block it
+        // used to be desugared into
+        std::any visitFORStmt (std::shared_ptr<FOR> stmt) override {
+            beginScope();
+            if (stmt->initializer != nullptr) resolve(stmt->initializer);
+            if (stmt->condition != nullptr) resolve(stmt->condition);
+            resolve(stmt->body);
+            if (stmt->increment != nullptr) resolve(stmt->increment);
+            int slotEnd = nextSlot;
+            Scope scope = endScope();
+            interpreter.resolveScope(stmt, scope.captured, scope.slotStart, slotEnd);
             return nullptr;
         }
 
@@ -96,7 +203,7 @@ class Resolver: public ExprVisitor, public StmtVisitor {
             ClassType enclosingClass = currentClass;
             currentClass = ClassType::KLASS;
 
-            declare(stmt->name);
+            declare(stmt, stmt->name);
             define(stmt->name);
 
             if (stmt->superclass != nullptr && stmt->name.lexeme == stmt->superclass->name.lexeme) { // added in ch13
@@ -110,36 +217,38 @@ class Resolver: public ExprVisitor, public StmtVisitor {
 
             if (stmt->superclass != nullptr) { // added in ch13
                 beginScope();
-                scopes.back()["super"] = true;
+                addLocal("super", true);
             }
 
-            beginScope();
-            scopes.back()["this"] = true;
-
+            // 'this' now lives in slot 0 of each method... updated for upvalue closures
             for (std::shared_ptr<Function> method : stmt->methods) {
                 FunctionType declaration = FunctionType::METHOD;
                 if (method->name.lexeme == "init") declaration = FunctionType::INITIALIZER;
                 resolveFunction(method, declaration);
             }
 
-            endScope();
-
-            if (stmt->superclass != nullptr) endScope(); // added in ch13
+            if (stmt->superclass != nullptr) { // added in ch13
+                Scope scope = endScope();
+                interpreter.resolveScope(stmt, scope.captured, scope.slotStart, scope.slotStart + 1);
+            }
 
             currentClass = enclosingClass;
             return {};
         }
 
         std::any visitVARStmt (std::shared_ptr<VAR> stmt) override {
-            declare(stmt->name);
+            declare(stmt, stmt->name);
             if (stmt->initializer != nullptr) resolve(stmt->initializer);
             define(stmt->name);
             return nullptr;
         }
 
         std::any visitVariableExpr (std::shared_ptr<Variable> expr) override {
-            if (!scopes.empty() && scopes.back().find(expr->name.lexeme) != scopes.back().end() && !scopes.back()[expr->name.lexeme]) {
-                error(expr->name, "Can't read local variable in its own initializer.");
+            if (!scopes.empty()) {
+                auto local = scopes.back().locals.find(expr->name.lexeme);
+                if (local != scopes.back().locals.end() && !local->second.defined) {
+                    error(expr->name, "Can't read local variable in its own initializer.");
+                }
             }
 
             resolveLocal(expr, expr->name);
@@ -153,7 +262,7 @@ class Resolver: public ExprVisitor, public StmtVisitor {
         }
 
         std::any visitFunctionStmt (std::shared_ptr<Function> stmt) override {
-            declare(stmt->name);
+            declare(stmt, stmt->name);
             define(stmt->name);
 
             // resolveFunction(stmt);
@@ -185,6 +294,12 @@ class Resolver: public ExprVisitor, public StmtVisitor {
 
             if (stmt->value != nullptr) resolve(stmt->value);
 
+            // added for tail calls... nothing is left to do after a returned call except hand its value back, so the
+            // call can take over this function's frame. Initializers still have to return 'this' afterwards
+            if (currentFunction != FunctionType::INITIALIZER && dynamic_cast<const Call*>(stmt->value.get()) != nullptr) {
+                interpreter.resolveTailCall(stmt);
+            }
+
             return {};
         }
 
@@ -206,6 +321,13 @@ class Resolver: public ExprVisitor, public StmtVisitor {
             return {};
         }
 
+        // added for superinstructions... the Optimizer makes these after we've run, but they resolve like the GET and Call
+        std::any visitInvokeExpr (std::shared_ptr<Invoke> expr) override {
+            resolve(expr->object);
+            for (const std::shared_ptr<Expr>& argument : expr->arguments) resolve(argument);
+            return {};
+        }
+
         // added in ch12
         std::any visitGETExpr (std::shared_ptr<GET> expr) override {
             resolve(expr->object);
@@ -238,6 +360,10 @@ class Resolver: public ExprVisitor, public StmtVisitor {
             else if (currentClass != ClassType::SUBCLASS) error(expr->keyword, "Can't user 'super' in a class with no superclass.");
 
             resolveLocal(expr, expr->keyword);
+
+            // super.method also needs the receiver to bind to
+            Interpreter::Local receiver;
+            if (findLocal("this", receiver)) interpreter.resolveReceiver(expr, receiver);
             return {};
         }
 
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// setitimer and sigaction are POSIX. Anywhere else there's no SIGPROF to sample with, and --sample is a usage error
+#if defined(__unix__) || defined(__APPLE__)
+#define LOX_SAMPLING
+#include <sys/time.h>
+#endif
+
+#include "Interpreter.hpp"
+#include "Output.hpp"
+#include "Stmt.hpp"
+
+// added for the sampling profiler... a SIGPROF timer interrupts the interpreter every so often and the handler copies
+// the Lox call stack (Interpreter::callStack, kept up to date by LoxFunction::call) into a ring buffer. The samples
+// are folded into "outer;inner count" lines, which flamegraph.pl and friends read directly.
+// updated to drop the drain thread... a second thread makes every shared_ptr count atomic, which cost more than the
+// sampling itself. The handler asks the Interpreter to drain once the ring is half full, and it does that on its own
+// thread the next time a Lox call returns. Code that makes no calls can fill the ring before that, so it's big enough
+// for several seconds of samples, and whatever is left is drained when the sampler stops.
+// Only one Sampler can run at a time since the signal handler has to find it through a static.
+class Sampler {
+    static constexpr int MAX_DEPTH = 128; // deeper stacks keep their outermost frames and end in "[deeper]"
+    // static constexpr size_t RING_SIZE = 1024; // power of two
+    static constexpr size_t RING_SIZE = 8192; // power of two... new[] leaves it untouched, so unused pages cost nothing
+
+    struct Sample {
+        int depth;
+        bool truncated;
+        std::array<const Function*, MAX_DEPTH> frames;
+    };
+
+    // single producer (the handler), single consumer (drain(), which the handler can interrupt), so two counters are
+    // all the locking needed
+    std::unique_ptr<Sample[]> ring{new Sample[RING_SIZE]};
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    std::atomic<long> dropped{0};
+    static_assert(std::atomic<size_t>::is_always_lock_free, "the signal handler can't take a lock");
+
+    Interpreter& interpreter;
+    std::string path;
+    std::map<std::string, long> folded;
+    std::vector<std::vector<std::shared_ptr<Stmt>>> programs; // keeps sampled Function nodes alive until we name them
+    bool running = false;
+
+    static inline Sampler* active = nullptr;
+
+    public:
+        static constexpr long DEFAULT_INTERVAL_US = 1000;
+#ifdef LOX_SAMPLING
+        static constexpr bool AVAILABLE = true;
+#else
+        static constexpr bool AVAILABLE = false;
+#endif
+
+        Sampler (Interpreter& interpreter, std::string path) : interpreter{interpreter}, path{std::move(path)} {}
+
+        ~Sampler () { stop(); }
+
+        void start (long intervalMicros) {
+            active = this;
+            running = true;
+            interpreter.drainSamples = [] { if (active != nullptr) active->drain(); };
+
+#ifdef LOX_SAMPLING
+            struct sigaction action{};
+            action.sa_handler = handler;
+            action.sa_flags = SA_RESTART; // reads and writes in the script shouldn't fail just because we sampled
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGPROF, &action, nullptr);
+
+            itimerval timer{};
+            timer.it_interval.tv_usec = intervalMicros % 1000000;
+            timer.it_interval.tv_sec = intervalMicros / 1000000;
+            timer.it_value = timer.it_interval;
+            setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+        }
+
+        // the Function nodes in the samples are named after the fact, so run() hands over each program it executes
+        void retain (const std::vector<std::shared_ptr<Stmt>>& statements) { programs.push_back(statements); }
+
+        void stop () {
+            if (!running) return;
+
+#ifdef LOX_SAMPLING
+            itimerval timer{};
+            setitimer(ITIMER_PROF, &timer, nullptr);
+            signal(SIGPROF, SIG_IGN);
+#endif
+
+            running = false;
+            drain();
+            active = nullptr;
+            interpreter.drainSamples = nullptr;
+
+            write();
+        }
+
+    private:
+        static void handler (int) {
+            Sampler* sampler = active;
+            if (sampler != nullptr) sampler->record();
+        }
+
+        // runs inside the signal handler: no allocation, no locks, just copying pointers
+        void record () {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == RING_SIZE) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            Sample& sample = ring[h % RING_SIZE];
+            int depth = interpreter.callDepth;
+            std::atomic_signal_fence(std::memory_order_acquire);
+            sample.truncated = depth > MAX_DEPTH;
+            sample.depth = sample.truncated ? MAX_DEPTH : depth;
+            for (int i = 0; i < sample.depth; i++) sample.frames[i] = interpreter.callStack[i].function;
+
+            head.store(h + 1, std::memory_order_release);
+            if (h + 1 - tail.load(std::memory_order_relaxed) >= RING_SIZE / 2) interpreter.drainRequested = 1;
+        }
+
+        void drain () {
+            interpreter.drainRequested = 0;
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_acquire);
+
+            for (; t != h; t++) {
+                const Sample& sample = ring[t % RING_SIZE];
+                std::string stack = "<script>";
+                for (int i = 0; i < sample.depth; i++) {
+                    stack += ';';
+                    stack += sample.frames[i]->name.lexeme + ":" + std::to_string(sample.frames[i]->name.line);
+                }
+                if (sample.truncated) stack += ";[deeper]";
+                folded[stack]++;
+
+                tail.store(t + 1, std::memory_order_release);
+            }
+        }
+
+        void write () {
+            std::ofstream file{path};
+            if (!file) {
+                std::cerr << "Failed opening sample file " << path << "\n";
+                return;
+            }
+
+            long samples = 0;
+            for (const auto& [stack, count] : folded) {
+                file << stack << ' ' << count << '\n';
+                samples += count;
+            }
+
+            output.flush();
+            std::cerr << "Sampler: " << samples << " samples written to " << path;
+            if (dropped > 0) std::cerr << " (" << dropped << " dropped, ring buffer full)";
+            std::cerr << "\n";
+        }
+};
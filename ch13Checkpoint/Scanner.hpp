@@ -1,5 +1,9 @@
 #pragma once
 
+#include <any>
+#include <charconv>
+#include <limits>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -30,6 +34,10 @@ class Scanner {
         static const std::unordered_map<std::string, TokenType> keywords;
         int curr = 0, line = 1, start = 0;
 
+        // added for fast literals... this compilation's constant pool, keyed by the literal's text in the source. A
+        // string literal that shows up again shares the first one's LoxString, and a fractional number skips parsing
+        std::unordered_map<std::string_view, std::any> constants;
+
         bool isAtEnd() { return curr >= src.length(); }
         
         bool isDigit (char isMe) { return isMe >= '0' && isMe <= '9'; } // if between 0 and 9 isMe is indeed a digit
@@ -80,18 +88,45 @@ class Scanner {
             advance();
 
             // trim the surring quotes 
-            std::string val{src.substr(start + 1, curr - 2 - start)};
-            addToken(String, val);
+            // std::string val{src.substr(start + 1, curr - 2 - start)};
+            // the literal is already the runtime string object, so the parser and interpreter only ever share it
+            std::any& constant = constants[src.substr(start, curr - start)];
+            if (!constant.has_value()) constant = std::make_shared<LoxString>(std::string{src.substr(start + 1, curr - 2 - start)});
+            addToken(String, constant);
         }
 
         void readNum() {
             while (isDigit(peek())) advance();
 
+            // plain integers that fit in a double's 53 bits convert exactly as we go, no parsing needed... added for fast literals
+            if (!(peek() == '.' && isDigit(peekNext())) && curr - start <= 15) {
+                long long value = 0;
+                for (int i = start; i < curr; ++i) value = value * 10 + (src[i] - '0');
+                addToken(Number, static_cast<double>(value));
+                return;
+            }
+
             // see if it's a float
             if (peek() == '.' && isDigit(peekNext())) advance(); // consume decimal point char
             while (isDigit(peek())) advance(); // get rest of num
 
-            addToken(Number, std::stod(std::string{src.substr(start, curr - start)})); // add new num token and convert str to a double 
+            // addToken(Number, std::stod(std::string{src.substr(start, curr - start)})); // add new num token and convert str to a double 
+            // from_chars reads straight out of the source and doesn't care about the locale
+            std::string_view text = src.substr(start, curr - start);
+            std::any& constant = constants[text];
+            if (!constant.has_value()) {
+                double value = 0;
+                auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+                // too big or too small for a double leaves value alone, round it the way strtod and jlox do. Only a
+                // literal with a nonzero digit before its decimal point can be too big
+                if (error == std::errc::result_out_of_range) {
+                    size_t digit = text.find_first_not_of('0');
+                    value = text[digit] != '.' ? std::numeric_limits<double>::infinity() : 0.0;
+                }
+                constant = value;
+            }
+
+            addToken(Number, constant);
         }     
 
         void readId () {
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Cache.hpp"
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxInstance.hpp"
+#include "LoxNative.hpp"
+#include "Upvalue.hpp"
+
+// added for --snapshot and --restore... everything the globals can reach once a script has run (classes, functions
+// and their closed upvalues, instances, strings) saved to a file, so a later run starts with those globals already
+// defined instead of running the script that built them. The functions' trees go along with them, written the same
+// way --cache writes a program, and the rest of the heap is written in the order it has to be rebuilt: upvalues
+// (empty), then functions, classes (superclasses first), instances, and last whatever can point back at something
+// (receivers, fields, upvalue values) so cycles between them come back as cycles. Natives are written by name and
+// looked up again in the restoring Interpreter.
+class HeapSnapshot: public ProgramFile {
+    static constexpr char MAGIC[4] = {'L', 'O', 'X', 'S'};
+    static constexpr std::uint32_t FORMAT = 1; // bump when the layout below changes
+
+    enum class HeapTag : std::uint8_t { VALUE, FUNCTION, CLASS, INSTANCE, NATIVE };
+
+    Interpreter& interpreter;
+    std::string build; // a snapshot only restores into the build that wrote it
+
+    // numbers every object reachable from the globals. It keeps its own worklist, a long chain of instances would
+    // overflow the native stack if this recursed
+    template <typename Object>
+    struct Numbered {
+        std::unordered_map<const Object*, std::uint32_t> ids;
+        std::vector<const Object*> objects;
+
+        bool add (const Object* object) {
+            if (ids.count(object) != 0) return false;
+            ids.emplace(object, objects.size());
+            objects.push_back(object);
+            return true;
+        }
+
+        std::uint32_t operator[] (const Object* object) const { return ids.at(object); }
+    };
+
+    struct Heap {
+        Numbered<Upvalue> upvalues;
+        Numbered<LoxFunction> functions;
+        Numbered<LoxClass> classes;
+        Numbered<LoxInstance> instances;
+        std::vector<const std::any*> pending;
+
+        void reach (const std::any& value) { pending.push_back(&value); }
+
+        void reachClass (const LoxClass* klass) {
+            // superclasses get the lower numbers, so each class is rebuilt after the one it inherits from
+            std::vector<const LoxClass*> chain;
+            for (const LoxClass* c = klass; c != nullptr && classes.ids.count(c) == 0; c = c->superclass.get()) chain.push_back(c);
+            for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+                classes.add(*c);
+                for (const auto& [name, method] : (*c)->methods) reachFunction(method.get());
+            }
+        }
+
+        void reachFunction (const LoxFunction* function) {
+            if (!functions.add(function)) return;
+            for (const auto& upvalue : function->upvalues) {
+                // by the time the script is done every frame has returned, so every upvalue is closed
+                if (upvalue->location != &upvalue->closed) throw Unsupported{};
+                if (upvalues.add(upvalue.get())) reach(upvalue->closed);
+            }
+            if (function->receiver != nullptr) reachInstance(function->receiver.get());
+        }
+
+        void reachInstance (const LoxInstance* instance) {
+            if (!instances.add(instance)) return;
+            reachClass(instance->klass.get());
+            for (const auto& [name, field] : instance->fields) reach(field);
+        }
+
+        void walk () {
+            while (!pending.empty()) {
+                const std::any& value = *pending.back();
+                pending.pop_back();
+                if (auto function = callableOf<LoxFunction>(value, CallableKind::FUNCTION)) reachFunction(function.get());
+                else if (auto klass = callableOf<LoxClass>(value, CallableKind::CLASS)) reachClass(klass.get());
+                else if (value.type() == typeid(std::shared_ptr<LoxInstance>))
+                    reachInstance(std::any_cast<const std::shared_ptr<LoxInstance>&>(value).get());
+            }
+        }
+    };
+
+    static void writeValue (ProgramWriter& writer, const Heap& heap, const std::any& value) {
+        if (auto function = callableOf<LoxFunction>(value, CallableKind::FUNCTION)) {
+            writer.raw(HeapTag::FUNCTION);
+            writer.raw(heap.functions[function.get()]);
+        }
+        else if (auto klass = callableOf<LoxClass>(value, CallableKind::CLASS)) {
+            writer.raw(HeapTag::CLASS);
+            writer.raw(heap.classes[klass.get()]);
+        }
+        else if (value.type() == typeid(std::shared_ptr<LoxInstance>)) {
+            writer.raw(HeapTag::INSTANCE);
+            writer.raw(heap.instances[std::any_cast<const std::shared_ptr<LoxInstance>&>(value).get()]);
+        }
+        else if (auto native = callableOf<LoxNative>(value, CallableKind::NATIVE)) {
+            writer.raw(HeapTag::NATIVE);
+            writer.text(native->name);
+        }
+        else {
+            writer.raw(HeapTag::VALUE);
+            writer.value(value);
+        }
+    }
+
+    // everything read so far, in the order it was numbered when it was written
+    struct Objects {
+        std::vector<std::shared_ptr<Upvalue>> upvalues;
+        std::vector<std::shared_ptr<LoxFunction>> functions;
+        std::vector<std::shared_ptr<LoxClass>> classes;
+        std::vector<std::shared_ptr<LoxInstance>> instances;
+    };
+
+    template <typename Object>
+    static const std::shared_ptr<Object>& pick (ProgramReader& reader, const std::vector<std::shared_ptr<Object>>& objects) {
+        std::uint32_t id = reader.raw<std::uint32_t>();
+        if (id >= objects.size()) throw Corrupt{};
+        return objects[id];
+    }
+
+    std::any readValue (ProgramReader& reader, const Objects& objects) {
+        switch (reader.raw<HeapTag>()) {
+            case HeapTag::VALUE: return reader.value();
+            case HeapTag::FUNCTION: return std::shared_ptr<LoxCallable>{pick(reader, objects.functions)};
+            case HeapTag::CLASS: return std::shared_ptr<LoxCallable>{pick(reader, objects.classes)};
+            case HeapTag::INSTANCE: return pick(reader, objects.instances);
+            case HeapTag::NATIVE: {
+                std::any* native = interpreter.globals->find(reader.text());
+                if (native == nullptr || callableOf<LoxNative>(*native, CallableKind::NATIVE) == nullptr) throw Corrupt{};
+                return *native;
+            }
+        }
+        throw Corrupt{};
+    }
+
+    public:
+        HeapSnapshot (Interpreter& interpreter, std::string build) : interpreter{interpreter}, build{std::move(build)} {}
+
+        // false when something in the globals can't be written or the file can't be
+        bool save (const std::filesystem::path& path) {
+            ProgramWriter writer;
+            try {
+                writer.out.append(MAGIC, sizeof MAGIC);
+                writer.raw(FORMAT);
+                writer.raw(hash(build));
+
+                const auto& globals = interpreter.globals->values;
+                Heap heap;
+                for (const auto& [name, value] : globals) heap.reach(value);
+                heap.walk();
+
+                // the trees the functions run, and what the Resolver worked out about them
+                std::vector<std::shared_ptr<Function>> declarations;
+                std::unordered_map<const Function*, std::uint32_t> declarationIds;
+                for (const LoxFunction* function : heap.functions.objects) {
+                    if (declarationIds.emplace(function->declaration.get(), declarations.size()).second)
+                        declarations.push_back(function->declaration);
+                }
+                writer.list(declarations);
+                writer.tables(interpreter);
+
+                writer.raw(static_cast<std::uint32_t>(heap.upvalues.objects.size()));
+
+                writer.raw(static_cast<std::uint32_t>(heap.functions.objects.size()));
+                for (const LoxFunction* function : heap.functions.objects) {
+                    writer.raw(declarationIds.at(function->declaration.get()));
+                    writer.raw(static_cast<std::uint32_t>(function->upvalues.size()));
+                    for (const auto& upvalue : function->upvalues) writer.raw(heap.upvalues[upvalue.get()]);
+                    writer.raw<std::uint8_t>(function->isInitializer);
+                }
+
+                writer.raw(static_cast<std::uint32_t>(heap.classes.objects.size()));
+                for (const LoxClass* klass : heap.classes.objects) {
+                    writer.text(klass->name);
+                    // 0 for none, otherwise one past its number
+                    writer.raw<std::uint32_t>(klass->superclass == nullptr ? 0 : heap.classes[klass->superclass.get()] + 1);
+                    writer.raw(static_cast<std::uint32_t>(klass->methods.size()));
+                    for (const auto& [name, method] : klass->methods) {
+                        writer.text(name);
+                        writer.raw(heap.functions[method.get()]);
+                    }
+                }
+
+                writer.raw(static_cast<std::uint32_t>(heap.instances.objects.size()));
+                for (const LoxInstance* instance : heap.instances.objects) writer.raw(heap.classes[instance->klass.get()]);
+
+                for (const LoxFunction* function : heap.functions.objects)
+                    writer.raw<std::uint32_t>(function->receiver == nullptr ? 0 : heap.instances[function->receiver.get()] + 1);
+                for (const LoxInstance* instance : heap.instances.objects) {
+                    writer.raw(static_cast<std::uint32_t>(instance->fields.size()));
+                    for (const auto& [name, field] : instance->fields) {
+                        writer.text(name);
+                        writeValue(writer, heap, field);
+                    }
+                }
+                for (const Upvalue* upvalue : heap.upvalues.objects) writeValue(writer, heap, upvalue->closed);
+
+                writer.raw(static_cast<std::uint32_t>(globals.size()));
+                for (const auto& [name, value] : globals) {
+                    writer.text(name);
+                    writeValue(writer, heap, value);
+                }
+            } catch (const Unsupported&) {
+                return false;
+            }
+            return write(path, writer.out);
+        }
+
+        // false when the file is missing, from another build or damaged. Nothing reaches the Interpreter until the
+        // whole file has read back cleanly
+        bool restore (const std::filesystem::path& path) {
+            std::string in;
+            if (!read(path, in)) return false;
+
+            try {
+                ProgramReader reader{in};
+                char magic[sizeof MAGIC];
+                for (char& c : magic) c = reader.raw<char>();
+                if (std::memcmp(magic, MAGIC, sizeof MAGIC) != 0 || reader.raw<std::uint32_t>() != FORMAT) return false;
+                if (reader.raw<std::uint64_t>() != hash(build)) return false;
+
+                std::vector<std::shared_ptr<Function>> declarations;
+                for (auto& declaration : reader.stmtList()) declarations.push_back(reader.as<Function>(declaration));
+                reader.tables();
+
+                Objects objects;
+                for (std::uint32_t n = reader.count(); n > 0; --n) {
+                    auto upvalue = std::make_shared<Upvalue>(nullptr);
+                    upvalue->location = &upvalue->closed;
+                    objects.upvalues.push_back(std::move(upvalue));
+                }
+
+                for (std::uint32_t n = reader.count(); n > 0; --n) {
+                    std::uint32_t declaration = reader.raw<std::uint32_t>();
+                    if (declaration >= declarations.size()) throw Corrupt{};
+                    std::vector<std::shared_ptr<Upvalue>> upvalues;
+                    for (std::uint32_t m = reader.count(); m > 0; --m) upvalues.push_back(pick(reader, objects.upvalues));
+                    bool isInitializer = reader.raw<std::uint8_t>() != 0;
+                    objects.functions.push_back(std::make_shared<LoxFunction>(declarations[declaration], std::move(upvalues), isInitializer));
+                }
+
+                for (std::uint32_t n = reader.count(); n > 0; --n) {
+                    std::string name = reader.text();
+                    std::uint32_t superclass = reader.raw<std::uint32_t>();
+                    if (superclass > objects.classes.size()) throw Corrupt{};
+                    std::map<std::string, std::shared_ptr<LoxFunction>> methods;
+                    for (std::uint32_t m = reader.count(); m > 0; --m) {
+                        std::string method = reader.text();
+                        methods[method] = pick(reader, objects.functions);
+                    }
+                    objects.classes.push_back(std::make_shared<LoxClass>(std::move(name),
+                        superclass == 0 ? nullptr : objects.classes[superclass - 1], std::move(methods)));
+                }
+
+                for (std::uint32_t n = reader.count(); n > 0; --n)
+                    objects.instances.push_back(std::make_shared<LoxInstance>(pick(reader, objects.classes)));
+
+                for (const auto& function : objects.functions) {
+                    std::uint32_t receiver = reader.raw<std::uint32_t>();
+                    if (receiver > objects.instances.size()) throw Corrupt{};
+                    if (receiver != 0) function->receiver = objects.instances[receiver - 1];
+                }
+                for (const auto& instance : objects.instances) {
+                    for (std::uint32_t n = reader.count(); n > 0; --n) {
+                        std::string name = reader.text();
+                        instance->fields[name] = readValue(reader, objects);
+                    }
+                }
+                for (const auto& upvalue : objects.upvalues) upvalue->closed = readValue(reader, objects);
+
+                std::vector<std::pair<std::string, std::any>> globals;
+                for (std::uint32_t n = reader.count(); n > 0; --n) {
+                    std::string name = reader.text();
+                    globals.emplace_back(std::move(name), readValue(reader, objects));
+                }
+                if (reader.at != reader.end) return false;
+
+                reader.resolve(interpreter);
+                for (auto& [name, value] : globals) interpreter.globals->define(name, std::move(value));
+                return true;
+            } catch (const Corrupt&) {
+                return false;
+            }
+        }
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
+#include "Allocations.hpp"
 #include "Token.hpp"
 
 #include "Expr.hpp"
@@ -11,6 +13,7 @@
 struct Block;
 struct CLASS;
 struct Expression;
+struct FOR;
 struct Function;
 struct IF;
 struct PRINT;
@@ -22,6 +25,7 @@ struct StmtVisitor {
 	virtual std::any visitBlockStmt(std::shared_ptr<Block> stmt) = 0;
 	virtual std::any visitCLASSStmt(std::shared_ptr<CLASS> stmt) = 0;
 	virtual std::any visitExpressionStmt(std::shared_ptr<Expression> stmt) = 0;
+	virtual std::any visitFORStmt(std::shared_ptr<FOR> stmt) = 0;
 	virtual std::any visitFunctionStmt(std::shared_ptr<Function> stmt) = 0;
 	virtual std::any visitIFStmt(std::shared_ptr<IF> stmt) = 0;
 	virtual std::any visitPRINTStmt(std::shared_ptr<PRINT> stmt) = 0;
@@ -31,13 +35,28 @@ struct StmtVisitor {
 	virtual ~StmtVisitor() = default;
 };
 
+enum class StmtKind : std::uint8_t {
+	Block,
+	CLASS,
+	Expression,
+	FOR,
+	Function,
+	IF,
+	PRINT,
+	RETURN,
+	VAR,
+	WHILE,
+};
+
 struct Stmt {
+	explicit Stmt(StmtKind kind) : kind{kind} {}
 	virtual std::any accept(StmtVisitor& visitor) = 0;
+	const StmtKind kind;
 };
 
-struct Block: Stmt, public std::enable_shared_from_this<Block> {
+struct Block: Stmt, public std::enable_shared_from_this<Block>, Counted<Block, AllocationKind::AST_NODE> {
   Block(std::vector<std::shared_ptr<Stmt>> statements)
-    : statements{std::move(statements)}
+    : Stmt{StmtKind::Block}, statements{std::move(statements)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -47,9 +66,9 @@ struct Block: Stmt, public std::enable_shared_from_this<Block> {
 	const std::vector<std::shared_ptr<Stmt>> statements;
 };
 
-struct CLASS: Stmt, public std::enable_shared_from_this<CLASS> {
+struct CLASS: Stmt, public std::enable_shared_from_this<CLASS>, Counted<CLASS, AllocationKind::AST_NODE> {
   CLASS(Token name, std::shared_ptr<Variable> superclass, std::vector<std::shared_ptr<Function>> methods)
-    : name{std::move(name)}, superclass{std::move(superclass)}, methods{std::move(methods)}
+    : Stmt{StmtKind::CLASS}, name{std::move(name)}, superclass{std::move(superclass)}, methods{std::move(methods)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -61,9 +80,9 @@ struct CLASS: Stmt, public std::enable_shared_from_this<CLASS> {
 	const std::vector<std::shared_ptr<Function>> methods;
 };
 
-struct Expression: Stmt, public std::enable_shared_from_this<Expression> {
+struct Expression: Stmt, public std::enable_shared_from_this<Expression>, Counted<Expression, AllocationKind::AST_NODE> {
   Expression(std::shared_ptr<Expr> expression)
-    : expression{std::move(expression)}
+    : Stmt{StmtKind::Expression}, expression{std::move(expression)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -73,9 +92,25 @@ struct Expression: Stmt, public std::enable_shared_from_this<Expression> {
 	const std::shared_ptr<Expr> expression;
 };
 
-struct Function: Stmt, public std::enable_shared_from_this<Function> {
+struct FOR: Stmt, public std::enable_shared_from_this<FOR>, Counted<FOR, AllocationKind::AST_NODE> {
+  FOR(std::shared_ptr<Stmt> initializer, std::shared_ptr<Expr> condition, std::shared_ptr<Expr> increment, std::shared_ptr<Stmt> body)
+    : Stmt{StmtKind::FOR}, initializer{std::move(initializer)}, condition{std::move(condition)}, increment{std::move(increment)}, body{std::move(body)}
+  {}
+
+	std::any accept(StmtVisitor& visitor) override {
+		return visitor.visitFORStmt(shared_from_this());
+  }
+
+	const std::shared_ptr<Stmt> initializer;
+	const std::shared_ptr<Expr> condition;
+	const std::shared_ptr<Expr> increment;
+	const std::shared_ptr<Stmt> body;
+	CountedLoop counted;
+};
+
+struct Function: Stmt, public std::enable_shared_from_this<Function>, Counted<Function, AllocationKind::AST_NODE> {
   Function(Token name, std::vector<Token> params, std::vector<std::shared_ptr<Stmt>> body)
-    : name{std::move(name)}, params{std::move(params)}, body{std::move(body)}
+    : Stmt{StmtKind::Function}, name{std::move(name)}, params{std::move(params)}, body{std::move(body)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -87,9 +122,9 @@ struct Function: Stmt, public std::enable_shared_from_this<Function> {
 	const std::vector<std::shared_ptr<Stmt>> body;
 };
 
-struct IF: Stmt, public std::enable_shared_from_this<IF> {
+struct IF: Stmt, public std::enable_shared_from_this<IF>, Counted<IF, AllocationKind::AST_NODE> {
   IF(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> thenBranch, std::shared_ptr<Stmt> elseBranch)
-    : condition{std::move(condition)}, thenBranch{std::move(thenBranch)}, elseBranch{std::move(elseBranch)}
+    : Stmt{StmtKind::IF}, condition{std::move(condition)}, thenBranch{std::move(thenBranch)}, elseBranch{std::move(elseBranch)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -99,11 +134,12 @@ struct IF: Stmt, public std::enable_shared_from_this<IF> {
 	const std::shared_ptr<Expr> condition;
 	const std::shared_ptr<Stmt> thenBranch;
 	const std::shared_ptr<Stmt> elseBranch;
+	Binary* test = nullptr;
 };
 
-struct PRINT: Stmt, public std::enable_shared_from_this<PRINT> {
+struct PRINT: Stmt, public std::enable_shared_from_this<PRINT>, Counted<PRINT, AllocationKind::AST_NODE> {
   PRINT(std::shared_ptr<Expr> expression)
-    : expression{std::move(expression)}
+    : Stmt{StmtKind::PRINT}, expression{std::move(expression)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -113,9 +149,9 @@ struct PRINT: Stmt, public std::enable_shared_from_this<PRINT> {
 	const std::shared_ptr<Expr> expression;
 };
 
-struct RETURN: Stmt, public std::enable_shared_from_this<RETURN> {
+struct RETURN: Stmt, public std::enable_shared_from_this<RETURN>, Counted<RETURN, AllocationKind::AST_NODE> {
   RETURN(Token keyword, std::shared_ptr<Expr> value)
-    : keyword{std::move(keyword)}, value{std::move(value)}
+    : Stmt{StmtKind::RETURN}, keyword{std::move(keyword)}, value{std::move(value)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -126,9 +162,9 @@ struct RETURN: Stmt, public std::enable_shared_from_this<RETURN> {
 	const std::shared_ptr<Expr> value;
 };
 
-struct VAR: Stmt, public std::enable_shared_from_this<VAR> {
+struct VAR: Stmt, public std::enable_shared_from_this<VAR>, Counted<VAR, AllocationKind::AST_NODE> {
   VAR(Token name, std::shared_ptr<Expr> initializer)
-    : name{std::move(name)}, initializer{std::move(initializer)}
+    : Stmt{StmtKind::VAR}, name{std::move(name)}, initializer{std::move(initializer)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -139,9 +175,9 @@ struct VAR: Stmt, public std::enable_shared_from_this<VAR> {
 	const std::shared_ptr<Expr> initializer;
 };
 
-struct WHILE: Stmt, public std::enable_shared_from_this<WHILE> {
+struct WHILE: Stmt, public std::enable_shared_from_this<WHILE>, Counted<WHILE, AllocationKind::AST_NODE> {
   WHILE(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> body)
-    : condition{std::move(condition)}, body{std::move(body)}
+    : Stmt{StmtKind::WHILE}, condition{std::move(condition)}, body{std::move(body)}
   {}
 
 	std::any accept(StmtVisitor& visitor) override {
@@ -150,5 +186,6 @@ struct WHILE: Stmt, public std::enable_shared_from_this<WHILE> {
 
 	const std::shared_ptr<Expr> condition;
 	const std::shared_ptr<Stmt> body;
+	Binary* test = nullptr;
 };
 
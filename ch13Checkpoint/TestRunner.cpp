@@ -0,0 +1,305 @@
+// added for the test runner... finds every tests/**/*.lox, runs them on a pool of worker threads (each one forking the
+// interpreter) and checks stdout, stderr and the exit code against the test's own comments:
+//
+//   // expect: <line>                   a line of stdout
+//   // expect runtime error: <message>  "<message>" then "[line N]" on stderr, exit code 70
+//   // Error ...                        "[line N] Error ..." on stderr, exit code 65
+//   // [line N] Error ...               same, for errors reported on another line ("[java line N]" too)
+//   // expect exit: <code>               the exit code, whatever ends up on stderr
+//   // flags: <options> [script]         one run of the interpreter with these options before the script. Every
+//                                        flags line is another run, in order. {tmp} is a directory made for the
+//                                        test and shared by its runs, {here} is the test's own directory. A run of
+//                                        another script (relative to {here}, named *.lox.in so it isn't a test of
+//                                        its own) only has to exit with 0, the expectations are for this one
+//
+// usage: test_runner <interpreter> [test directory] [jobs]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// suites that only make sense for clox (scanner/expression-only builds, bytecode limits)
+const std::vector<std::string> SKIPPED = {
+    "scanning/", "expressions/", "limit/loop_too_large.lox", "limit/no_reuse_constants.lox", "limit/too_many_"
+};
+
+constexpr int TIMEOUT_MS = 10000;
+
+struct Run {
+    std::vector<std::string> flags;
+    std::string script; // empty for the test itself
+};
+
+struct Expectation {
+    std::vector<std::string> out;
+    std::vector<std::string> err;
+    int exitCode = 0;
+    bool checkErr = true;
+    std::vector<Run> runs;
+};
+
+struct Result {
+    std::string path;
+    bool passed = false;
+    double seconds = 0;
+    std::vector<std::string> failures;
+};
+
+Expectation parseExpectations (const std::string& path) {
+    static const std::regex expectOutput{"// expect: ?(.*)"};
+    static const std::regex expectRuntimeError{"// expect runtime error: (.+)"};
+    static const std::regex syntaxError{"// (Error.*)"};
+    static const std::regex lineError{"// \\[((java|c) )?line (\\d+)\\] (Error.*)"};
+    static const std::regex expectExit{"// expect exit: (\\d+)"};
+    static const std::regex flags{"// flags:(.*)"};
+
+    Expectation expected;
+    std::ifstream file{path};
+    std::string line;
+    std::smatch match;
+
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        if (std::regex_search(line, match, expectOutput)) expected.out.push_back(match[1]);
+
+        if (std::regex_search(line, match, expectRuntimeError)) {
+            expected.err = {match[1], "[line " + std::to_string(lineNumber) + "]"};
+            expected.exitCode = 70;
+        }
+
+        if (std::regex_search(line, match, syntaxError)) {
+            expected.err.push_back("[line " + std::to_string(lineNumber) + "] " + match[1].str());
+            expected.exitCode = 65;
+        }
+
+        if (std::regex_search(line, match, lineError) && match[2] != "c") {
+            expected.err.push_back("[line " + match[3].str() + "] " + match[4].str());
+            expected.exitCode = 65;
+        }
+
+        if (std::regex_search(line, match, expectExit)) {
+            expected.exitCode = std::stoi(match[1]);
+            expected.checkErr = false;
+        }
+
+        if (std::regex_search(line, match, flags)) {
+            Run run;
+            std::istringstream words{match[1].str()};
+            for (std::string word; words >> word;) run.flags.push_back(word);
+            if (!run.flags.empty() && run.flags.back().compare(0, 2, "--") != 0) {
+                run.script = run.flags.back();
+                run.flags.pop_back();
+            }
+            expected.runs.push_back(run);
+        }
+    }
+
+    if (expected.runs.empty()) expected.runs.push_back(Run{});
+    return expected;
+}
+
+std::vector<std::string> splitLines (const std::string& text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for (size_t end; (end = text.find('\n', start)) != std::string::npos; start = end + 1) {
+        lines.push_back(text.substr(start, end - start));
+    }
+    if (start < text.size()) lines.push_back(text.substr(start));
+    return lines;
+}
+
+// runs the interpreter on one script, collecting both pipes without letting either one fill up and block the child
+// updated for flags... the options go in front of the script
+bool runInterpreter (const std::string& interpreter, const std::vector<std::string>& flags, const std::string& script,
+                     std::string& out, std::string& err, int& exitCode) {
+    std::vector<char*> argv{const_cast<char*>(interpreter.c_str())};
+    for (const std::string& flag : flags) argv.push_back(const_cast<char*>(flag.c_str()));
+    argv.push_back(const_cast<char*>(script.c_str()));
+    argv.push_back(nullptr);
+
+    // close-on-exec, or a child another worker forks right now inherits these write ends and we don't see EOF until
+    // it exits too. dup2() clears the flag on the copies our own child keeps
+    int outPipe[2], errPipe[2];
+    if (pipe2(outPipe, O_CLOEXEC) < 0) return false;
+    if (pipe2(errPipe, O_CLOEXEC) < 0) { close(outPipe[0]); close(outPipe[1]); return false; }
+
+    pid_t pid = fork();
+    if (pid < 0) { close(outPipe[0]); close(outPipe[1]); close(errPipe[0]); close(errPipe[1]); return false; }
+    if (pid == 0) {
+        dup2(outPipe[1], STDOUT_FILENO);
+        dup2(errPipe[1], STDERR_FILENO);
+        close(outPipe[0]); close(outPipe[1]); close(errPipe[0]); close(errPipe[1]);
+        // execl(interpreter.c_str(), interpreter.c_str(), script.c_str(), static_cast<char*>(nullptr));
+        execv(interpreter.c_str(), argv.data());
+        _exit(127);
+    }
+    close(outPipe[1]);
+    close(errPipe[1]);
+
+    pollfd fds[2] = {{outPipe[0], POLLIN, 0}, {errPipe[0], POLLIN, 0}};
+    std::string* sinks[2] = {&out, &err};
+    int open = 2;
+    bool timedOut = false;
+    char buffer[4096];
+
+    while (open > 0) {
+        int ready = poll(fds, 2, TIMEOUT_MS);
+        if (ready == 0) { timedOut = true; kill(pid, SIGKILL); break; }
+        if (ready < 0) break;
+
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = read(fds[i].fd, buffer, sizeof buffer);
+            if (n > 0) sinks[i]->append(buffer, n);
+            else { close(fds[i].fd); fds[i].fd = -1; open--; }
+        }
+    }
+    for (pollfd& fd : fds) if (fd.fd >= 0) close(fd.fd);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (timedOut) exitCode = -1;
+    else exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return !timedOut;
+}
+
+void compareLines (const char* stream, const std::vector<std::string>& expected, const std::vector<std::string>& actual,
+                   std::vector<std::string>& failures) {
+    size_t count = std::max(expected.size(), actual.size());
+    for (size_t i = 0; i < count; i++) {
+        if (i < expected.size() && i < actual.size() && expected[i] == actual[i]) continue;
+
+        std::string want = i < expected.size() ? "'" + expected[i] + "'" : "nothing";
+        std::string got = i < actual.size() ? "'" + actual[i] + "'" : "nothing";
+        failures.push_back(std::string{stream} + " line " + std::to_string(i + 1) + ": expected " + want + ", got " + got);
+        return; // the first mismatch is enough, the rest usually just cascades from it
+    }
+}
+
+std::string expand (std::string flag, const std::string& name, const std::string& value) {
+    for (size_t at; (at = flag.find(name)) != std::string::npos;) flag.replace(at, name.size(), value);
+    return flag;
+}
+
+// updated for flags... runs the test once per flags line, stopping at the first run that fails
+Result runTest (const std::string& interpreter, const std::string& path) {
+    Result result;
+    result.path = path;
+    Expectation expected = parseExpectations(path);
+
+    std::string here = fs::path{path}.parent_path().generic_string();
+    std::string tmp;
+    if (expected.runs.size() > 1 || !expected.runs[0].flags.empty()) {
+        std::string pattern = (fs::temp_directory_path() / "lox_test_XXXXXX").string();
+        if (mkdtemp(pattern.data()) == nullptr) {
+            result.failures.push_back("couldn't make a directory for {tmp}");
+            return result;
+        }
+        tmp = pattern;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < expected.runs.size() && result.failures.empty(); i++) {
+        const Run& run = expected.runs[i];
+        std::vector<std::string> flags;
+        for (const std::string& flag : run.flags) flags.push_back(expand(expand(flag, "{tmp}", tmp), "{here}", here));
+        std::string script = run.script.empty() ? path : here + "/" + run.script;
+        std::string prefix = expected.runs.size() > 1 ? "run " + std::to_string(i + 1) + ": " : "";
+
+        std::string out, err;
+        int exitCode = 0;
+        if (!runInterpreter(interpreter, flags, script, out, err, exitCode)) {
+            result.failures.push_back(prefix + "timed out after " + std::to_string(TIMEOUT_MS / 1000) + "s");
+            break;
+        }
+
+        if (!run.script.empty()) {
+            if (exitCode != 0) result.failures.push_back(prefix + run.script + " exited with " + std::to_string(exitCode) + ": " + err);
+            continue;
+        }
+
+        compareLines("stdout", expected.out, splitLines(out), result.failures);
+        if (expected.checkErr) compareLines("stderr", expected.err, splitLines(err), result.failures);
+        if (exitCode != expected.exitCode) {
+            result.failures.push_back("exit code: expected " + std::to_string(expected.exitCode) + ", got " + std::to_string(exitCode));
+        }
+        for (std::string& failure : result.failures) failure = prefix + failure;
+    }
+    result.seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+    if (!tmp.empty()) {
+        std::error_code ignored;
+        fs::remove_all(tmp, ignored);
+    }
+
+    result.passed = result.failures.empty();
+    return result;
+}
+
+bool skipped (const std::string& relative) {
+    return std::any_of(SKIPPED.begin(), SKIPPED.end(), [&](const std::string& prefix) {
+        return relative.compare(0, prefix.size(), prefix) == 0;
+    });
+}
+
+int main (int argc, char* argv[]) {
+    if (argc < 2 || argc > 4) {
+        std::cerr << "Usage: test_runner <interpreter> [test directory] [jobs]" << std::endl;
+        return 64;
+    }
+
+    std::string interpreter = argv[1];
+    fs::path directory = argc > 2 ? argv[2] : "tests";
+    unsigned jobs = argc > 3 ? std::stoul(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::string> tests;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator{directory}) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".lox") continue;
+        if (skipped(entry.path().lexically_relative(directory).generic_string())) continue;
+        tests.push_back(entry.path().generic_string());
+    }
+    std::sort(tests.begin(), tests.end());
+
+    std::vector<Result> results(tests.size());
+    std::atomic<size_t> next{0};
+    std::mutex printing;
+
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < tests.size();) {
+            results[i] = runTest(interpreter, tests[i]);
+
+            std::lock_guard<std::mutex> lock{printing};
+            std::cout << (results[i].passed ? "PASS " : "FAIL ") << results[i].path
+                      << " (" << static_cast<int>(results[i].seconds * 1000) << " ms)\n";
+            for (const std::string& failure : results[i].failures) std::cout << "    " << failure << "\n";
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < std::min<size_t>(jobs, tests.size()); i++) pool.emplace_back(worker);
+    for (std::thread& thread : pool) thread.join();
+    double elapsed = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+    size_t passed = std::count_if(results.begin(), results.end(), [](const Result& result) { return result.passed; });
+    std::cout << "\n" << passed << " passed, " << tests.size() - passed << " failed, "
+              << tests.size() << " total in " << elapsed << "s" << std::endl;
+
+    return passed == tests.size() ? 0 : 1;
+}
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <any>
+#include <memory>
 #include <string>
 #include <utility> 
+#include "LoxString.hpp"
 #include "TokenType.hpp"
 
 class Token {
@@ -33,7 +35,7 @@ class Token {
                     break;
                 case (String) :
                     // For tokens of type String, extract the string literal from the 'literal' member
-                    str = std::any_cast<std::string>(literal);
+                    str = std::any_cast<const std::shared_ptr<LoxString>&>(literal)->str();
                     break;
                 case (True) :
                     str = "true"; 
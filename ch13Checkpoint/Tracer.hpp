@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+
+// added for --trace... writes Chrome trace_event JSON (chrome://tracing, Perfetto) as the program runs: a begin/end
+// pair for each phase of run() and each Lox function call. Everything is on one pid/tid since the interpreter is
+// single threaded. The file is only valid JSON once the Tracer is destroyed and closes the array.
+class Tracer {
+    using Clock = std::chrono::steady_clock;
+
+    std::ofstream file;
+    Clock::time_point start = Clock::now();
+    bool first = true;
+
+    public:
+        Tracer (const std::string& path) : file{path} {
+            file << std::fixed << std::setprecision(3); // timestamps are microseconds, keep them exact past one second
+            file << "{\"traceEvents\":[\n";
+        }
+
+        ~Tracer () { file << "\n],\"displayTimeUnit\":\"ms\"}\n"; }
+
+        bool ok () const { return static_cast<bool>(file); }
+
+        void begin (std::string_view name, const char* category, int line = -1) { event(name, category, 'B', line); }
+
+        void end (std::string_view name, const char* category) { event(name, category, 'E', -1); }
+
+    private:
+        void event (std::string_view name, const char* category, char phase, int line) {
+            double micros = std::chrono::duration<double, std::micro>{Clock::now() - start}.count();
+
+            if (!first) file << ",\n";
+            first = false;
+
+            file << "{\"name\":\"";
+            escape(name);
+            file << "\",\"cat\":\"" << category << "\",\"ph\":\"" << phase << "\",\"ts\":" << micros << ",\"pid\":1,\"tid\":1";
+            if (line >= 0) file << ",\"args\":{\"line\":" << line << "}";
+            file << "}";
+        }
+
+        // Lox identifiers never need it, but keep the file valid whatever the name is
+        void escape (std::string_view text) {
+            for (char c : text) {
+                if (c == '"' || c == '\\') file << '\\' << c;
+                else if (static_cast<unsigned char>(c) < 0x20) file << ' ';
+                else file << c;
+            }
+        }
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <any>
+
+// added for upvalue closures... a local some closure captured. While the local's frame is live, location points at
+// its stack slot. When the scope exits, the interpreter "closes" it by moving the value into closed and pointing
+// location there instead, so the closure never cares which case it's in
+struct Upvalue {
+    std::any* location;
+    std::any closed;
+
+    Upvalue (std::any* location) : location{location} {}
+};
@@ -1,3 +1,7 @@
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <charconv>
 #include <cstring> 
 #include <fstream>
 #include <iostream>
@@ -5,20 +9,59 @@
 #include <string_view>
 #include <vector>
 
+// mmap and ucontext are POSIX. Anywhere else the interpreter runs on the process's own stack
+#if defined(__unix__) || defined(__APPLE__)
+#define LOX_OWN_STACK
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
 // #include "ASTPrint.hpp"
+#include "Cache.hpp"
 #include "Error.hpp"
 #include "Interpreter.hpp"
+#include "Optimizer.hpp"
 #include "Parser.hpp"
+#include "Profiler.hpp"
 #include "Resolver.hpp"
+#include "Sampler.hpp"
 #include "Scanner.hpp"
+#include "Snapshot.hpp"
 
 // I was receiving some strange errors, and I found online to try this to layout files similarly to the Java code. 
 // It worked, but I am not sure why.
 #include "LoxFunction.cpp" 
 #include "LoxClass.cpp"    
 #include "LoxInstance.cpp" 
+#include "LoxNative.cpp"
+
+std::unique_ptr<Tracer> tracer; // --trace=file, outlives the interpreter so every call's end event gets written
+// Interpreter interpreter{}; // added in ch07
+// updated for the profiler... --profile swaps in a ProfilingInterpreter, which reports when this is destroyed at exit
+std::unique_ptr<Interpreter> interpreter = std::make_unique<Interpreter>();
+ProfilingInterpreter* profiler = nullptr;
+bool optimize = true; // --no-optimize runs the tree exactly as parsed
+std::unique_ptr<Sampler> sampler; // --sample=file, destroyed (and written out) before the interpreter it watches
+// added for the frame stack... every Lox call recurses on the native stack too, a few hundred bytes to however much
+// its expressions nest, so the interpreter gets a big stack of its own and is told where it ends. Untouched stack
+// pages cost nothing. --stack-size=0 keeps the process's own stack
+size_t stackSizeMB = 512;
+const char* script = nullptr;
+std::unique_ptr<ProgramCache> cache; // --cache=dir, only for a script
+// added for snapshots... --restore=file defines the globals a snapshot saved before anything runs, --snapshot=file
+// saves the globals once the script has run without errors
+std::string restorePath, snapshotPath;
+const std::string build = __DATE__ " " __TIME__; // cached programs and snapshots are only read by the build that wrote them
 
-Interpreter interpreter{}; // added in ch07
+// added for --stats... registered with atexit so it still runs when runFile() exits on an error
+void printStats () {
+    output.flush();
+    allocations.report(std::cerr);
+    std::cerr << "optimizer: " << optimizerStats.folded << " folded, " << optimizerStats.propagated << " propagated, "
+              << optimizerStats.removed << " statements removed, " << optimizerStats.fused << " fused\n";
+}
 
 std::string read(std::string_view fileName) {
     std::ifstream file{fileName.data()};
@@ -32,23 +75,62 @@ std::string read(std::string_view fileName) {
 }
 
 // Function to run the interpreter on a provided source code string
-void run (std::string_view src) {
+// updated for --cache... everything up to running the program moved to compile()
+std::vector<std::shared_ptr<Stmt>> compile (std::string_view src) {
+    if (tracer != nullptr) tracer->begin("scan", "phase");
     Scanner scanner {src}; // create a scanner for the source code
     std::vector<Token> tokens = scanner.scanTokens(); // get tokens based on source
+    if (tracer != nullptr) tracer->end("scan", "phase");
 
+    if (tracer != nullptr) tracer->begin("parse", "phase");
     Parser parser{tokens};
+    if (profiler != nullptr) parser.lines = &profiler->lines;
     // std::shared_ptr<Expr> expression = parser.parse(); // since ch08
     std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+    if (tracer != nullptr) tracer->end("parse", "phase");
+
+    // a syntax error leaves null statements behind, so don't hand them to the resolver
+    if (hadError) return {};
 
-    Resolver resolver{interpreter}; // added in ch11
+    if (tracer != nullptr) tracer->begin("resolve", "phase");
+    Resolver resolver{*interpreter}; // added in ch11
     resolver.resolve(statements); // added in ch11
+    if (tracer != nullptr) tracer->end("resolve", "phase");
 
     // stop if syntx error
-    if (hadError) return;
+    if (hadError) return {};
+
+    // added for the optimizer
+    if (optimize) {
+        if (tracer != nullptr) tracer->begin("optimize", "phase");
+        statements = Optimizer{*interpreter, profiler != nullptr ? &profiler->lines : nullptr}.optimize(statements);
+        if (tracer != nullptr) tracer->end("optimize", "phase");
+    }
+    return statements;
+}
+
+void run (std::string_view src) {
+    std::vector<std::shared_ptr<Stmt>> statements;
+    if (tracer != nullptr) tracer->begin("load", "phase");
+    bool cached = cache != nullptr && cache->load(src, statements);
+    if (tracer != nullptr) tracer->end("load", "phase");
+
+    if (!cached) {
+        statements = compile(src);
+        if (hadError) return;
+        if (cache != nullptr) {
+            if (tracer != nullptr) tracer->begin("store", "phase");
+            cache->store(src, statements);
+            if (tracer != nullptr) tracer->end("store", "phase");
+        }
+    }
+    if (sampler != nullptr) sampler->retain(statements);
 
     // std::cout << ASTPrinter{}.print(expression) << std::endl; ... deleted in ch07
     //interpreter.interpret(expression); // added in ch07... changed in ch08
-    interpreter.interpret(statements);
+    if (tracer != nullptr) tracer->begin("execute", "phase");
+    interpreter->interpret(statements);
+    if (tracer != nullptr) tracer->end("execute", "phase");
 }
 
 // Function to run the interpreter on a source code file
@@ -58,12 +140,19 @@ void runFile (std::string_view src) {
 
     if (hadError) std::exit(65); // If there was an error, exit with an error code
     if (hadRuntimeError) std::exit(70); // added in ch07
+
+    if (!snapshotPath.empty() && !HeapSnapshot{*interpreter, build}.save(snapshotPath)) {
+        std::cerr << "Failed writing snapshot " << snapshotPath << "\n";
+        std::exit(74);
+    }
 }
 
 // Function to run the interpreter in a REPL
 void runPrompt() {
     for (;;) {
-        std::cout << "cLL> ";
+        // std::cout << "cLL> ";
+        output.write("cLL> ");
+        output.flush(); // whatever is buffered has to show before we wait on the user
         std::string line;
         if (!std::getline(std::cin, line)) break; // if nothing left, break
         run(line);
@@ -71,12 +160,135 @@ void runPrompt() {
     }
 }
 
+void runInterpreter () {
+    if (!restorePath.empty() && !HeapSnapshot{*interpreter, build}.restore(restorePath)) {
+        std::cerr << "Failed restoring snapshot " << restorePath << " (missing, damaged or from another build)\n";
+        std::exit(66);
+    }
+    if (script != nullptr) runFile(script); // Execute the interpreter on the provided script file
+    else runPrompt(); // Run the interactive prompt if no script is provided
+}
+
+// the stack runInterpreter() gets when it isn't given one. Windows' default is 1 MB
+size_t processStackBytes () {
+#ifdef LOX_OWN_STACK
+    rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0) return limit.rlim_cur == RLIM_INFINITY ? SIZE_MAX : limit.rlim_cur;
+#endif
+    return 1 << 20;
+}
+
+// returns false if the stack couldn't be mapped, and the caller runs it where it is. It's a context switch on the
+// same thread rather than a thread of its own: as long as the process has one thread, shared_ptr's reference counts
+// skip the atomic instructions, and the interpreter copies shared_ptrs constantly
+#ifdef LOX_OWN_STACK
+bool runOnOwnStack (size_t megabytes) {
+    size_t size = megabytes << 20;
+    void* stack = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) return false;
+    size_t guard = sysconf(_SC_PAGESIZE);
+    mprotect(stack, guard, PROT_NONE); // overflowing it still crashes instead of writing past it
+    interpreter->nativeStackEnd(reinterpret_cast<std::uintptr_t>(stack) + guard);
+
+    ucontext_t caller, interpreterContext;
+    getcontext(&interpreterContext);
+    interpreterContext.uc_stack.ss_sp = stack;
+    interpreterContext.uc_stack.ss_size = size;
+    interpreterContext.uc_link = &caller; // back here when runInterpreter returns
+    makecontext(&interpreterContext, runInterpreter, 0);
+    swapcontext(&caller, &interpreterContext);
+
+    munmap(stack, size);
+    return true;
+}
+#else
+bool runOnOwnStack (size_t) { return false; }
+#endif
+
+// added for numeric options... the whole value has to be a number, anything else is a usage error like an unknown option
+template <typename Number>
+Number numberOption (std::string_view option, size_t prefix) {
+    std::string_view text = option.substr(prefix);
+    Number value{};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != std::errc{} || end != text.data() + text.size()) {
+        std::cerr << "Invalid value for " << option.substr(0, prefix - 1) << ": " << text << "\n";
+        exit(64);
+    }
+    return value;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc > 2) {
-        std::cout << "Usage: Lox [script]" << "\n";
+    // options come before the script... added for buffered output
+    int arg = 1;
+    std::string samplePath;
+    std::string cacheDir;
+    long sampleInterval = Sampler::DEFAULT_INTERVAL_US;
+    size_t maxDepth = Interpreter::DEFAULT_MAX_DEPTH;
+    for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; ++arg) {
+        std::string_view option = argv[arg];
+        if (option.substr(0, 18) == "--flush-threshold=") output.setThreshold(numberOption<size_t>(option, 18));
+        else if (option == "--profile") {
+            auto profiling = std::make_unique<ProfilingInterpreter>();
+            profiler = profiling.get();
+            interpreter = std::move(profiling);
+        }
+        else if (option.substr(0, 9) == "--sample=") {
+            if (!Sampler::AVAILABLE) {
+                std::cerr << "Sampling isn't available on this platform\n";
+                exit(64);
+            }
+            samplePath = option.substr(9);
+        }
+        else if (option.substr(0, 18) == "--sample-interval=") sampleInterval = numberOption<long>(option, 18);
+        else if (option == "--stats") std::atexit(printStats);
+        else if (option == "--no-optimize") optimize = false;
+        else if (option.substr(0, 8) == "--cache=") cacheDir = option.substr(8);
+        else if (option.substr(0, 11) == "--snapshot=") snapshotPath = option.substr(11);
+        else if (option.substr(0, 10) == "--restore=") restorePath = option.substr(10);
+        else if (option.substr(0, 12) == "--max-depth=") maxDepth = numberOption<size_t>(option, 12);
+        else if (option.substr(0, 13) == "--stack-size=") stackSizeMB = numberOption<size_t>(option, 13);
+        else if (option.substr(0, 8) == "--trace=") {
+            tracer = std::make_unique<Tracer>(std::string{option.substr(8)});
+            if (!tracer->ok()) {
+                std::cerr << "Failed opening trace file " << option.substr(8) << "\n";
+                exit(64);
+            }
+        }
+        else {
+            std::cout << "Unknown option: " << option << "\n";
+            exit(64);
+        }
+    }
+
+    if (argc - arg > 1) {
+        std::cout << "Usage: Lox [--flush-threshold=bytes] [--profile] [--sample=file] [--sample-interval=us] [--trace=file] [--stats] [--no-optimize] [--max-depth=calls] [--stack-size=MB] [--cache=dir] [--snapshot=file] [--restore=file] [script]" << "\n";
         exit(64);
     }
 
-    else if (argc == 2) runFile(argv[1]); // Execute the interpreter on the provided script file
-    else runPrompt(); // Run the interactive prompt if no script is provided
+    interpreter->tracer = tracer.get();
+    interpreter->maxCallDepth = maxDepth;
+
+    if (!samplePath.empty()) {
+        sampler = std::make_unique<Sampler>(*interpreter, samplePath);
+        sampler->start(sampleInterval);
+    }
+
+    // if (argc - arg == 1) runFile(argv[arg]); // Execute the interpreter on the provided script file
+    // else runPrompt(); // Run the interactive prompt if no script is provided
+    if (argc - arg == 1) script = argv[arg];
+
+    // the profiler numbers the statements as they're parsed, so it always parses. Anything else that changes what
+    // compile() produces has to be part of the build string
+    if (!cacheDir.empty() && script != nullptr && profiler == nullptr) {
+        cache = std::make_unique<ProgramCache>(*interpreter, cacheDir, build + (optimize ? " optimized" : " unoptimized"));
+    }
+    if (stackSizeMB == 0 || !runOnOwnStack(stackSizeMB)) {
+        // main's frame is within a few KB of where the process's stack starts, the margin covers the difference
+        char top;
+        std::uintptr_t start = reinterpret_cast<std::uintptr_t>(&top);
+        size_t bytes = processStackBytes();
+        if (bytes < start) interpreter->nativeStackEnd(start - bytes); // an unlimited stack has no end to check
+        runInterpreter();
+    }
 }
\ No newline at end of file